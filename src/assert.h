@@ -33,6 +33,11 @@
             "function '%s' passed incorrect type for arg %i; got %s, expected expression type", \
             fname, i, awlval_type_name(args->cell[i]->type));
 
+#define AWLASSERT_ISCALLABLE(args, i, fname) \
+    AWLASSERT(args, (ISCALLABLE(args->cell[i]->type)), \
+            "function '%s' passed incorrect type for arg %i; got %s, expected callable", \
+            fname, i, awlval_type_name(args->cell[i]->type));
+
 #define AWLASSERT_ARGCOUNT(args, expected, fname) \
     AWLASSERT(args, (args->count == expected), \
             "function '%s' takes exactly %i argument(s); %i given", fname, expected, args->count);
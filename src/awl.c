@@ -7,9 +7,17 @@
 
 #include "assert.h"
 #include "builtins.h"
+#include "eval.h"
+#include "fold.h"
+#include "gc.h"
+#include "intern.h"
+#include "par.h"
 #include "parser.h"
+#include "pool.h"
 #include "print.h"
+#include "sched.h"
 #include "util.h"
+#include "vm.h"
 
 void run_scripts(awlenv* e, int argc, char** argv) {
     for (int i = 1; i < argc; i++) {
@@ -23,16 +31,70 @@ void run_scripts(awlenv* e, int argc, char** argv) {
     }
 }
 
+_Thread_local awl_runtime* awl_rt = NULL;
+
 void setup_awl(void) {
-    srand(time(NULL));
-    register_default_print_fn();
+    setup_immediates();
     setup_parser();
+    awl_runtime_new();
 }
 
 void teardown_awl(void) {
+    teardown_par();
+    awl_runtime_del(awl_rt);
     teardown_parser();
 }
 
+awl_runtime* awl_runtime_new(void) {
+    awl_runtime* rt = safe_malloc(sizeof(awl_runtime));
+    atomic_init(&rt->eval_pending, 0);
+    atomic_init(&rt->eval_aborted, 0);
+    atomic_init(&rt->eval_preempted, 0);
+    atomic_init(&rt->repl_aborted, 0);
+    awl_runtime_seed(rt, (uint64_t)time(NULL) ^ (uint64_t)(uintptr_t)rt);
+
+    awl_rt = rt;
+    register_default_print_fn();
+    setup_sched();
+    return rt;
+}
+
+void awl_runtime_del(awl_runtime* rt) {
+    teardown_sched();
+    awlval_expansions_clear();
+    teardown_vm();
+    teardown_fold();
+    teardown_gc();
+    teardown_pool();
+    teardown_intern();
+
+    if (awl_rt == rt) {
+        awl_rt = NULL;
+    }
+    free(rt);
+}
+
+void awl_runtime_abort(awl_runtime* rt) {
+    atomic_store(&rt->eval_aborted, 1);
+    atomic_store(&rt->eval_pending, 1);
+}
+
+void awl_runtime_seed(awl_runtime* rt, uint64_t seed) {
+    /* xorshift would stay at zero */
+    rt->rand_state = seed ? seed : 0x9e3779b97f4a7c15ULL;
+}
+
+double awl_runtime_random(awl_runtime* rt) {
+    uint64_t x = rt->rand_state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    rt->rand_state = x;
+
+    /* the top 53 bits of the scrambled state fill a double's mantissa */
+    return (double)((x * 0x2545f4914f6cdd1dULL) >> 11) / 9007199254740992.0;
+}
+
 char* get_awl_version(void) {
     return AWL_VERSION;
 }
@@ -3,12 +3,28 @@
 
 #define AWL_VERSION "v0.3.0"
 
+#include <stdint.h>
+
+#include "runtime.h"
 #include "types.h"
 
 /* system functions */
 void run_scripts(awlenv* e, int argc, char** argv);
+/* builds what every interpreter shares, and makes a runtime current on the
+ * calling thread; called once, before any other thread starts one */
 void setup_awl(void);
 void teardown_awl(void);
 char* get_awl_version(void);
 
+/* Each thread that runs an interpreter besides the one that called
+ * setup_awl makes a runtime of its own, and deletes it on that same
+ * thread once it is done with every value it evaluated */
+awl_runtime* awl_runtime_new(void);
+void awl_runtime_del(awl_runtime* rt);
+/* safe to call from any thread, or from a signal handler */
+void awl_runtime_abort(awl_runtime* rt);
+void awl_runtime_seed(awl_runtime* rt, uint64_t seed);
+/* uniform in [0, 1) */
+double awl_runtime_random(awl_runtime* rt);
+
 #endif
@@ -5,272 +5,351 @@
 #include <errno.h>
 #include <signal.h>
 #include <string.h>
+#include <limits.h>
 #include <math.h>
 #include <sys/stat.h>
 
 #include "assert.h"
+#include "awl.h"
 #include "eval.h"
+#include "gc.h"
+#include "par.h"
 #include "parser.h"
 #include "print.h"
 #include "repl.h"
+#include "sched.h"
 #include "util.h"
+#include "vm.h"
 
-#define UNARY_OP(a, op) { \
-    switch (a->type) { \
-        case AWLVAL_INT: \
-            a->lng = op a->lng; \
-            break; \
-        case AWLVAL_FLOAT: \
-            a->dbl = op a->dbl; \
-            break; \
-        default: break; \
-    } \
-}
+static const char* num_op_names[] = { "+", "-", "*", "/", "//", "%", "^" };
+static const char* ord_op_names[] = { ">", ">=", "<", "<=" };
 
-#define BINARY_OP(a, b, op) { \
-    switch (a->type) { \
-        case AWLVAL_INT: \
-            a->lng = a->lng op b->lng; \
-            break; \
-        case AWLVAL_FLOAT: \
-            a->dbl = a->dbl op b->dbl; \
-            break; \
-        default: break; \
-    } \
+/* Modulo operator, always positive; computed unsigned, as the magnitude
+ * of LONG_MIN does not fit in a long */
+static long modulo(long x, long y) {
+    unsigned long ux = x < 0 ? 0UL - (unsigned long)x : (unsigned long)x;
+    unsigned long uy = y < 0 ? 0UL - (unsigned long)y : (unsigned long)y;
+    return (long)(ux % uy);
 }
 
-#define BINARY_OP_RES(res, a, b, op) { \
-    switch (a->type) { \
-        case AWLVAL_INT: \
-            res = a->lng op b->lng; \
-            break; \
-        case AWLVAL_FLOAT: \
-            res = a->dbl op b->dbl; \
-            break; \
-        default: break; \
-    } \
+static double fmodulo(double x, double y) {
+    return fmod(fabs(x), fabs(y));
 }
 
-#define BINARY_OP_FUNC(a, b, func) { \
-    switch (a->type) { \
-        case AWLVAL_INT: \
-            a->lng = func (a->lng, b->lng); \
-            break; \
-        case AWLVAL_FLOAT: \
-            a->dbl = func (a->dbl, b->dbl); \
-            break; \
-        default: break; \
-    } \
+/* Unboxed numeric operand, so that arithmetic does not allocate per step */
+typedef struct {
+    awlval_type_t type;
+    union {
+        long lng;
+        double dbl;
+    };
+} awlnum;
+
+static awlnum awlnum_of(const awlval* v) {
+    awlnum n;
+    n.type = v->type;
+    if (v->type == AWLVAL_INT) {
+        n.lng = v->lng;
+    } else {
+        n.dbl = v->dbl;
+    }
+    return n;
 }
 
-long modulo(long x, long y) {
-    /* Modulo operator, always positive */
-    return labs(x) % labs(y);
+static double awlnum_dbl(const awlnum* n) {
+    return n->type == AWLVAL_FLOAT ? n->dbl : (double)n->lng;
 }
 
-double fmodulo(double x, double y) {
-    /* Modulo operator, always positive */
-    return fmod(fabs(x), fabs(y));
+static void awlnum_promote(awlnum* n) {
+    if (n->type != AWLVAL_FLOAT) {
+        n->type = AWLVAL_FLOAT;
+        n->dbl = (double)n->lng;
+    }
 }
 
-awlval* builtin_num_op(awlenv* e, awlval* a, char* op) {
-    /* Argcount must be checked in calling function, because
-     * different operators have different requirements */
-    EVAL_ARGS(e, a);
+static awlval* awlnum_box(const awlnum* n) {
+    return n->type == AWLVAL_INT ? awlval_int(n->lng) : awlval_float(n->dbl);
+}
 
-    for (int i = 0; i < a->count; i++) {
-        AWLASSERT_ISNUMERIC(a, i, op);
+typedef enum {
+    AWLNUM_OK,
+    AWLNUM_INEXACT,     /* the result is not an integer, or too large for one */
+    AWLNUM_OVERFLOW,
+    AWLNUM_DIV_ZERO,
+    AWLNUM_NAN
+} awlnum_status;
+
+static awlnum_status awlnum_int_pow(long* x, long y) {
+    /* only 1 and -1 have integer reciprocals */
+    if (y < 0) {
+        if (*x == 1 || *x == -1) {
+            *x = y % 2 == 0 ? 1 : *x;
+            return AWLNUM_OK;
+        }
+        return AWLNUM_INEXACT;
     }
 
-    awlval* x = awlval_pop(a, 0);
-    if (streq(op, "-") && a->count == 0) {
-        UNARY_OP(x, -);
+    /* a power too large for an integer is left to pow(), as it always was */
+    long base = *x;
+    long res = 1;
+    while (y > 0) {
+        if (y & 1 && __builtin_mul_overflow(res, base, &res)) {
+            return AWLNUM_INEXACT;
+        }
+        y >>= 1;
+        if (y > 0 && __builtin_mul_overflow(base, base, &base)) {
+            return AWLNUM_INEXACT;
+        }
     }
+    *x = res;
+    return AWLNUM_OK;
+}
 
-    while (a->count > 0) {
-        awlval* y = awlval_pop(a, 0);
+/* Fold y into x where both are integers. An inexact quotient or power, or
+ * a power too large for an integer, is left for the floating point kernel */
+static awlnum_status awlnum_int_op(awlnum_op op, long* x, long y) {
+    switch (op) {
+        case AWLNUM_ADD:
+            return __builtin_add_overflow(*x, y, x) ? AWLNUM_OVERFLOW : AWLNUM_OK;
+        case AWLNUM_SUB:
+            return __builtin_sub_overflow(*x, y, x) ? AWLNUM_OVERFLOW : AWLNUM_OK;
+        case AWLNUM_MUL:
+            return __builtin_mul_overflow(*x, y, x) ? AWLNUM_OVERFLOW : AWLNUM_OK;
+        case AWLNUM_DIV:
+        case AWLNUM_TRUNC_DIV:
+            if (y == 0) {
+                return AWLNUM_DIV_ZERO;
+            }
+            if (y == -1 && *x == LONG_MIN) {
+                return AWLNUM_OVERFLOW;
+            }
+            if (op == AWLNUM_DIV && *x % y != 0) {
+                return AWLNUM_INEXACT;
+            }
+            *x /= y;
+            return AWLNUM_OK;
+        case AWLNUM_MOD:
+            if (y == 0) {
+                return AWLNUM_DIV_ZERO;
+            }
+            *x = modulo(*x, y);
+            return AWLNUM_OK;
+        case AWLNUM_POW:
+            return awlnum_int_pow(x, y);
+    }
+    return AWLNUM_OK;
+}
 
-        awlval_maybe_promote_numeric(x, y);
+/* Fold y into x where either started out as a float; truncating division
+ * keeps the truncated result a float */
+static awlnum_status awlnum_float_op(awlnum_op op, double* x, double y) {
+    switch (op) {
+        case AWLNUM_ADD:
+            *x += y;
+            break;
+        case AWLNUM_SUB:
+            *x -= y;
+            break;
+        case AWLNUM_MUL:
+            *x *= y;
+            break;
+        case AWLNUM_DIV:
+        case AWLNUM_TRUNC_DIV:
+            if (y == 0) {
+                return AWLNUM_DIV_ZERO;
+            }
+            *x = op == AWLNUM_DIV ? *x / y : trunc(*x / y);
+            break;
+        case AWLNUM_MOD:
+            if (y == 0) {
+                return AWLNUM_DIV_ZERO;
+            }
+            *x = fmodulo(*x, y);
+            break;
+        case AWLNUM_POW:
+            *x = pow(*x, y);
+            if (isnan(*x)) {
+                return AWLNUM_NAN;
+            }
+            break;
+    }
+    return AWLNUM_OK;
+}
 
-        if (streq(op, "+")) { BINARY_OP(x, y, +); }
-        if (streq(op, "-")) { BINARY_OP(x, y, -); }
-        if (streq(op, "*")) { BINARY_OP(x, y, *); }
-        if (streq(op, "/") || streq(op, "//") || streq(op, "%")) {
-            /* Handle division or modulo by zero */
-            if ((y->type == AWLVAL_INT && y->lng == 0) ||
-                (y->type == AWLVAL_FLOAT && y->dbl == 0)) {
-                awlval* err = awlval_err("division by zero; %i %s 0", x->lng, op);
-                awlval_del(x);
-                awlval_del(y);
-                x = err;
-                break;
+static awlval* awlnum_err(awlnum_status status, awlnum_op op, const awlnum* x, const awlval* y) {
+    switch (status) {
+        case AWLNUM_DIV_ZERO:
+            if (x->type == AWLVAL_INT) {
+                return awlval_err("division by zero; %li %s 0", x->lng, num_op_names[op]);
             }
+            return awlval_err("division by zero; %f %s 0", x->dbl, num_op_names[op]);
+        case AWLNUM_OVERFLOW:
+            return awlval_err("integer overflow; %li %s %li", x->lng, num_op_names[op], y->lng);
+        case AWLNUM_NAN:
+            return awlval_err("pow resulted in NaN");
+        default:
+            return NULL;
+    }
+}
 
-            if (strstr(op, "/")) {
-                awlval_type_t oldtype_x = x->type;
-                awlval_type_t oldtype_y = y->type;
+awlval* builtin_num_op(awlenv* e, awlval* a, awlnum_op op) {
+    /* Argcount must be checked in calling function, because
+     * different operators have different requirements */
+    EVAL_ARGS(e, a);
 
-                /* Handle fractional integer division */
-                if (x->type == AWLVAL_INT && y->type == AWLVAL_INT && x->lng % y->lng != 0) {
-                    awlval_promote_numeric(x);
-                    awlval_promote_numeric(y);
-                }
+    for (int i = 0; i < a->count; i++) {
+        AWLASSERT_ISNUMERIC(a, i, num_op_names[op]);
+    }
 
-                BINARY_OP(x, y, /);
-
-                if (streq(op, "//")) {
-                    /* Truncating division, based on old types */
-                    if (oldtype_x == AWLVAL_INT && oldtype_y == AWLVAL_INT) {
-                        awlval_demote_numeric(x);
-                    } else {
-                        /* Truncate, but we still need to keep result a float */
-                        awlval_demote_numeric(x);
-                        awlval_promote_numeric(x);
-                    }
-                }
-            } else {
-                /* Handle modulo */
-                if (x->type == AWLVAL_FLOAT || y->type == AWLVAL_FLOAT) {
-                    BINARY_OP_FUNC(x, y, fmodulo);
-                } else {
-                    x->lng = modulo(x->lng, y->lng);
-                }
-            }
+    /* operands are read in place and folded into an unboxed accumulator,
+     * which stays an integer for as long as the operands do */
+    awlnum x = awlnum_of(a->cell[0]);
+    if (op == AWLNUM_SUB && a->count == 1) {
+        if (x.type == AWLVAL_FLOAT) {
+            x.dbl = -x.dbl;
+        } else if (__builtin_sub_overflow(0, x.lng, &x.lng)) {
+            awlval* err = awlval_err("integer overflow; - %li", a->cell[0]->lng);
+            awlval_del(a);
+            return err;
         }
-        if (streq(op, "^")) {
-            if (x->type == AWLVAL_FLOAT || y->type == AWLVAL_FLOAT) {
-                BINARY_OP_FUNC(x, y, pow);
-            } else {
-                /* Handle case where result is fractional */
-                double ans = pow((double)x->lng, y->lng);
-                if (ans - (double)(long)ans != 0.0) {
-                    x->type = AWLVAL_FLOAT;
-                    x->dbl = ans;
-                } else {
-                    x->lng = (long)ans;
-                }
-            }
+    }
 
-            // Check for NaN
-            if (x->type == AWLVAL_FLOAT && isnan(x->dbl)) {
-                awlval_del(x);
-                x = awlval_err("pow resulted in NaN");
+    awlval* err = NULL;
+    for (int i = 1; i < a->count && !err; i++) {
+        awlval* y = a->cell[i];
+        awlnum_status status;
+        if (x.type == AWLVAL_INT && y->type == AWLVAL_INT) {
+            long acc = x.lng;
+            status = awlnum_int_op(op, &acc, y->lng);
+            if (status == AWLNUM_OK) {
+                x.lng = acc;
+                continue;
+            }
+            if (status != AWLNUM_INEXACT) {
+                err = awlnum_err(status, op, &x, y);
+                continue;
             }
+            awlnum_promote(&x);
+        } else if (x.type == AWLVAL_INT) {
+            awlnum_promote(&x);
         }
 
-        awlval_del(y);
+        status = awlnum_float_op(op, &x.dbl, y->type == AWLVAL_FLOAT ? y->dbl : (double)y->lng);
+        err = awlnum_err(status, op, &x, y);
     }
 
     awlval_del(a);
-    return x;
+    return err ? err : awlnum_box(&x);
 }
 
 awlval* builtin_add(awlenv* e, awlval* a) {
     AWLASSERT_MINARGCOUNT(a, 2, "+");
-    return builtin_num_op(e, a, "+");
+    return builtin_num_op(e, a, AWLNUM_ADD);
 }
 
 awlval* builtin_sub(awlenv* e, awlval* a) {
     AWLASSERT_MINARGCOUNT(a, 1, "-");
-    return builtin_num_op(e, a, "-");
+    return builtin_num_op(e, a, AWLNUM_SUB);
 }
 
 awlval* builtin_mul(awlenv* e, awlval* a) {
     AWLASSERT_MINARGCOUNT(a, 2, "*");
-    return builtin_num_op(e, a, "*");
+    return builtin_num_op(e, a, AWLNUM_MUL);
 }
 
 awlval* builtin_div(awlenv* e, awlval* a) {
     AWLASSERT_MINARGCOUNT(a, 2, "/");
-    return builtin_num_op(e, a, "/");
+    return builtin_num_op(e, a, AWLNUM_DIV);
 }
 
 awlval* builtin_trunc_div(awlenv* e, awlval* a) {
     AWLASSERT_MINARGCOUNT(a, 2, "//");
-    return builtin_num_op(e, a, "//");
+    return builtin_num_op(e, a, AWLNUM_TRUNC_DIV);
 }
 
 awlval* builtin_mod(awlenv* e, awlval* a) {
     AWLASSERT_MINARGCOUNT(a, 2, "%");
-    return builtin_num_op(e, a, "%");
+    return builtin_num_op(e, a, AWLNUM_MOD);
 }
 
 awlval* builtin_pow(awlenv* e, awlval* a) {
     AWLASSERT_MINARGCOUNT(a, 2, "^");
-    return builtin_num_op(e, a, "^");
+    return builtin_num_op(e, a, AWLNUM_POW);
 }
 
-awlval* builtin_ord_op(awlenv* e, awlval* a, char* op) {
-    AWLASSERT_ARGCOUNT(a, 2, op);
+awlval* builtin_ord_op(awlenv* e, awlval* a, awlord_op op) {
+    AWLASSERT_ARGCOUNT(a, 2, ord_op_names[op]);
     EVAL_ARGS(e, a);
-    AWLASSERT_ISNUMERIC(a, 0, op);
-    AWLASSERT_ISNUMERIC(a, 1, op);
-
-    awlval* x = awlval_pop(a, 0);
-    awlval* y = awlval_pop(a, 0);
-
-    awlval_maybe_promote_numeric(x, y);
-
-    bool res;
-    if (streq(op, ">")) {
-        BINARY_OP_RES(res, x, y, >);
-    }
-    if (streq(op, "<")) {
-        BINARY_OP_RES(res, x, y, <);
-    }
-    if (streq(op, ">=")) {
-        BINARY_OP_RES(res, x, y, >=);
-    }
-    if (streq(op, "<=")) {
-        BINARY_OP_RES(res, x, y, <=);
+    AWLASSERT_ISNUMERIC(a, 0, ord_op_names[op]);
+    AWLASSERT_ISNUMERIC(a, 1, ord_op_names[op]);
+
+    /* integers are compared as they are; anything else as doubles */
+    int cmp;
+    if (a->cell[0]->type == AWLVAL_INT && a->cell[1]->type == AWLVAL_INT) {
+        long x = a->cell[0]->lng;
+        long y = a->cell[1]->lng;
+        cmp = (x > y) - (x < y);
+    } else {
+        awlnum xn = awlnum_of(a->cell[0]);
+        awlnum yn = awlnum_of(a->cell[1]);
+        double x = awlnum_dbl(&xn);
+        double y = awlnum_dbl(&yn);
+        /* NaN is unordered, and compares false either way */
+        cmp = x > y ? 1 : x < y ? -1 : x == y ? 0 : 2;
     }
-
-    awlval_del(y);
     awlval_del(a);
 
-    x->type = AWLVAL_BOOL;
-    x->bln = res;
-    return x;
+    bool res = false;
+    switch (op) {
+        case AWLORD_GT:
+            res = cmp == 1;
+            break;
+        case AWLORD_GTE:
+            res = cmp == 1 || cmp == 0;
+            break;
+        case AWLORD_LT:
+            res = cmp == -1;
+            break;
+        case AWLORD_LTE:
+            res = cmp == -1 || cmp == 0;
+            break;
+    }
+    return awlval_bool(res);
 }
 
 awlval* builtin_gt(awlenv* e, awlval* a) {
-    return builtin_ord_op(e, a, ">");
+    return builtin_ord_op(e, a, AWLORD_GT);
 }
 
 awlval* builtin_gte(awlenv* e, awlval* a) {
-    return builtin_ord_op(e, a, ">=");
+    return builtin_ord_op(e, a, AWLORD_GTE);
 }
 
 awlval* builtin_lt(awlenv* e, awlval* a) {
-    return builtin_ord_op(e, a, "<");
+    return builtin_ord_op(e, a, AWLORD_LT);
 }
 
 awlval* builtin_lte(awlenv* e, awlval* a) {
-    return builtin_ord_op(e, a, "<=");
+    return builtin_ord_op(e, a, AWLORD_LTE);
 }
 
-awlval* builtin_logic_op(awlenv* e, awlval* a, char* op) {
-    AWLASSERT_ARGCOUNT(a, 2, op);
+awlval* builtin_logic_op(awlenv* e, awlval* a, awllogic_op op) {
+    AWLASSERT_ARGCOUNT(a, 2, op == AWLLOGIC_EQ ? "==" : "!=");
     EVAL_ARGS(e, a);
 
-    bool eq = awlval_eq(a->cell[0], a->cell[1]);
-    bool res;
-    if (streq(op, "==")) {
-        res = eq;
-    }
-    if (streq(op, "!=")) {
-        res = !eq;
-    }
+    awlval* x = a->cell[0];
+    awlval* y = a->cell[1];
+    bool eq = x->type == AWLVAL_INT && y->type == AWLVAL_INT ? x->lng == y->lng : awlval_eq(x, y);
     awlval_del(a);
-    return awlval_bool(res);
+    return awlval_bool(op == AWLLOGIC_EQ ? eq : !eq);
 }
 
 awlval* builtin_eq(awlenv* e, awlval* a) {
-    return builtin_logic_op(e, a, "==");
+    return builtin_logic_op(e, a, AWLLOGIC_EQ);
 }
 
 awlval* builtin_neq(awlenv* e, awlval* a) {
-    return builtin_logic_op(e, a, "!=");
+    return builtin_logic_op(e, a, AWLLOGIC_NEQ);
 }
 
 awlval* builtin_bool_op(awlenv* e, awlval* a, char* op) {
@@ -280,8 +359,9 @@ awlval* builtin_bool_op(awlenv* e, awlval* a, char* op) {
         AWLASSERT_TYPE(a, 0, AWLVAL_BOOL, op);
 
         awlval* x = awlval_take(a, 0);
-        x->bln = !x->bln;
-        return x;
+        bool res = !x->bln;
+        awlval_del(x);
+        return awlval_bool(res);
     }
 
     AWLASSERT_ARGCOUNT(a, 2, op);
@@ -314,15 +394,17 @@ awlval* builtin_bool_op(awlenv* e, awlval* a, char* op) {
         return err;
     }
 
+    bool res = x->bln;
     if (streq(op, "and")) {
-        x->bln = x->bln && y->bln;
+        res = x->bln && y->bln;
     }
     if (streq(op, "or")) {
-        x->bln = x->bln || y->bln;
+        res = x->bln || y->bln;
     }
 
+    awlval_del(x);
     awlval_del(y);
-    return x;
+    return awlval_bool(res);
 }
 
 awlval* builtin_and(awlenv* e, awlval* a) {
@@ -356,6 +438,9 @@ awlval* builtin_qhead(awlenv* e, awlval* a) {
     awlval* q = awlval_take(a, 0);
     awlval* v = awlval_take(q, 0);
 
+    if (v->type == AWLVAL_SEXPR || v->type == AWLVAL_SYM) {
+        v = awlval_unshare(v);
+    }
     if (v->type == AWLVAL_SEXPR) {
         v->type = AWLVAL_QEXPR;
     } else if (v->type == AWLVAL_SYM) {
@@ -416,7 +501,7 @@ awlval* builtin_eval(awlenv* e, awlval* a) {
     EVAL_ARGS(e, a);
     AWLASSERT_TYPE(a, 0, AWLVAL_QEXPR, "eval");
 
-    awlval* x = awlval_take(a, 0);
+    awlval* x = awlval_unshare(awlval_take(a, 0));
     x->type = AWLVAL_SEXPR;
     return awlval_eval(e, x);
 }
@@ -425,11 +510,13 @@ awlval* builtin_append(awlenv* e, awlval* a) {
     AWLASSERT_MINARGCOUNT(a, 2, "append");
     EVAL_ARGS(e, a);
 
+    /* either all strings or all lists */
+    awlval_type_t t = a->cell[0]->type == AWLVAL_STR ? AWLVAL_STR : AWLVAL_QEXPR;
     for (int i = 0; i < a->count; i++) {
-        AWLASSERT_TYPE(a, i, AWLVAL_QEXPR, "append");
+        AWLASSERT_TYPE(a, i, t, "append");
     }
 
-    awlval* x = awlval_pop(a, 0);
+    awlval* x = awlval_unshare(awlval_pop(a, 0));
     while (a->count) {
         x = awlval_join(x, awlval_pop(a, 0));
     }
@@ -444,7 +531,7 @@ awlval* builtin_cons(awlenv* e, awlval* a) {
     AWLASSERT_TYPE(a, 1, AWLVAL_QEXPR, "cons");
 
     awlval* v = awlval_pop(a, 0);
-    awlval* x = awlval_take(a, 0);
+    awlval* x = awlval_unshare(awlval_take(a, 0));
     awlval_add_front(x, v);
     return x;
 }
@@ -459,6 +546,9 @@ awlval* builtin_dictget(awlenv* e, awlval* a) {
     awlval* k = awlval_take(a, 0);
 
     awlval* v = awlval_get_dict(d, k);
+    if (v == NULL) {
+        v = awlval_err("function 'dict-get' could not find key ':%s'", k->sym);
+    }
     awlval_del(d);
     awlval_del(k);
     return v;
@@ -470,7 +560,7 @@ awlval* builtin_dictset(awlenv* e, awlval* a) {
     AWLASSERT_TYPE(a, 0, AWLVAL_DICT, "dict-set");
     AWLASSERT_TYPE(a, 1, AWLVAL_QSYM, "dict-set");
 
-    awlval* d = awlval_pop(a, 0);
+    awlval* d = awlval_unshare(awlval_pop(a, 0));
     awlval* k = awlval_pop(a, 0);
     awlval* v = awlval_take(a, 0);
 
@@ -486,7 +576,7 @@ awlval* builtin_dictdel(awlenv* e, awlval* a) {
     AWLASSERT_TYPE(a, 0, AWLVAL_DICT, "dict-del");
     AWLASSERT_TYPE(a, 1, AWLVAL_QSYM, "dict-del");
 
-    awlval* d = awlval_pop(a, 0);
+    awlval* d = awlval_unshare(awlval_pop(a, 0));
     awlval* k = awlval_take(a, 0);
 
     awlval_rm_dict(d, k);
@@ -615,6 +705,381 @@ awlval* builtin_slice(awlenv* e, awlval* a) {
     return reverse_slice ? awlval_reverse(collection) : collection;
 }
 
+/* The higher-order list functions walk the cells of their list in place,
+ * in the order the recursive definitions they replace did: 'reduce' folds
+ * from the right, so 'map', 'filter', 'any' and 'all' call their function
+ * on the last element first. Elements are evaluated as 'head' would */
+static awlval* list_elem(awlenv* e, awlval* l, int i) {
+    return awlval_eval(e, awlval_retain(l->cell[i]));
+}
+
+static awlval* apply_unary(awlenv* e, awlval* f, awlval* x) {
+    return awlval_apply(e, awlval_retain(f), awlval_add(awlval_sexpr(), x));
+}
+
+static awlval* apply_predicate(awlenv* e, awlval* f, awlval* x, const char* fname) {
+    awlval* r = apply_unary(e, f, x);
+    if (r->type != AWLVAL_ERR && r->type != AWLVAL_BOOL) {
+        awlval* err = awlval_err("function '%s' passed predicate returning %s, expected %s",
+                fname, awlval_type_name(r->type), awlval_type_name(AWLVAL_BOOL));
+        awlval_del(r);
+        return err;
+    }
+    return r;
+}
+
+/* Given fewer arguments than it has formals, a list builtin is partially
+ * applied, as the Awl functions it replaces were: to a function of the
+ * formals left that calls it with all of them */
+static awlval* builtin_partial(awlenv* e, awlval* a, awlbuiltin builtin, const char* fname,
+        const char** names, int arity) {
+    awlval* formals = awlval_sexpr();
+    awlval* body = awlval_add(awlval_sexpr(), awlval_fun(builtin, fname));
+    for (int i = 0; i < arity; i++) {
+        formals = awlval_add(formals, awlval_sym(names[i]));
+        body = awlval_add(body, awlval_sym(names[i]));
+    }
+
+    awlval* f = awlval_lambda(e, formals, body);
+    awlval* x = awlval_call(e, f, a);
+    awlval_del(f);
+    return x;
+}
+
+#define BUILTIN_PARTIAL(env, args, builtin, fname, ...) { \
+    static const char* names[] = { __VA_ARGS__ }; \
+    int arity = sizeof(names) / sizeof(names[0]); \
+    if (args->count < arity) { \
+        return builtin_partial(env, args, builtin, fname, names, arity); \
+    } \
+}
+
+/* Each of these runs over the cells of l in [start, end), so that the
+ * parallel builtins can run them a chunk at a time (see par.h) */
+static awlval* reduce_chunk(awlenv* e, awlval* f, awlval* l, int start, int end, awlval* init) {
+    awlval* acc = awlval_retain(init);
+    for (int i = end - 1; i >= start; i--) {
+        awlval* x = list_elem(e, l, i);
+        if (x->type == AWLVAL_ERR) {
+            awlval_del(acc);
+            acc = x;
+            break;
+        }
+
+        awlval* args = awlval_add(awlval_add(awlval_sexpr(), acc), x);
+        acc = awlval_apply(e, awlval_retain(f), args);
+        if (acc->type == AWLVAL_ERR) {
+            break;
+        }
+    }
+    return acc;
+}
+
+static awlval* map_chunk(awlenv* e, awlval* f, awlval* l, int start, int end, awlval* init) {
+    (void)init;
+    awlval* acc = awlval_qexpr();
+    for (int i = end - 1; i >= start; i--) {
+        awlval* x = list_elem(e, l, i);
+        if (x->type != AWLVAL_ERR) {
+            x = apply_unary(e, f, x);
+        }
+        if (x->type == AWLVAL_ERR) {
+            awlval_del(acc);
+            acc = x;
+            break;
+        }
+        awlval_add_front(acc, x);
+    }
+    return acc;
+}
+
+static awlval* filter_chunk(awlenv* e, awlval* f, awlval* l, int start, int end, awlval* init) {
+    (void)init;
+    awlval* acc = awlval_qexpr();
+    for (int i = end - 1; i >= start; i--) {
+        awlval* x = list_elem(e, l, i);
+        awlval* keep = x->type == AWLVAL_ERR ? awlval_retain(x)
+            : apply_predicate(e, f, awlval_retain(x), "filter");
+        if (keep->type == AWLVAL_ERR) {
+            awlval_del(x);
+            awlval_del(acc);
+            acc = keep;
+            break;
+        }
+
+        if (keep->bln) {
+            awlval_add_front(acc, x);
+        } else {
+            awlval_del(x);
+        }
+        awlval_del(keep);
+    }
+    return acc;
+}
+
+awlval* builtin_reduce(awlenv* e, awlval* a) {
+    BUILTIN_PARTIAL(e, a, builtin_reduce, "reduce", "f", "l", "acc");
+    AWLASSERT_ARGCOUNT(a, 3, "reduce");
+    EVAL_ARGS(e, a);
+    AWLASSERT_ISCALLABLE(a, 0, "reduce");
+    AWLASSERT_TYPE(a, 1, AWLVAL_QEXPR, "reduce");
+
+    awlval* acc = reduce_chunk(e, a->cell[0], a->cell[1], 0, a->cell[1]->count, a->cell[2]);
+    awlval_del(a);
+    return acc;
+}
+
+awlval* builtin_map(awlenv* e, awlval* a) {
+    BUILTIN_PARTIAL(e, a, builtin_map, "map", "f", "l");
+    AWLASSERT_ARGCOUNT(a, 2, "map");
+    EVAL_ARGS(e, a);
+    AWLASSERT_ISCALLABLE(a, 0, "map");
+    AWLASSERT_TYPE(a, 1, AWLVAL_QEXPR, "map");
+
+    awlval* acc = map_chunk(e, a->cell[0], a->cell[1], 0, a->cell[1]->count, NULL);
+    awlval_del(a);
+    return acc;
+}
+
+awlval* builtin_filter(awlenv* e, awlval* a) {
+    BUILTIN_PARTIAL(e, a, builtin_filter, "filter", "f", "l");
+    AWLASSERT_ARGCOUNT(a, 2, "filter");
+    EVAL_ARGS(e, a);
+    AWLASSERT_ISCALLABLE(a, 0, "filter");
+    AWLASSERT_TYPE(a, 1, AWLVAL_QEXPR, "filter");
+
+    awlval* acc = filter_chunk(e, a->cell[0], a->cell[1], 0, a->cell[1]->count, NULL);
+    awlval_del(a);
+    return acc;
+}
+
+/* The chunks' lists are joined in order */
+static awlval* builtin_par_join(awlenv* e, awlval* a, const char* fname, par_chunk_fn chunk) {
+    AWLASSERT_ARGCOUNT(a, 2, fname);
+    EVAL_ARGS(e, a);
+    AWLASSERT_ISCALLABLE(a, 0, fname);
+    AWLASSERT_TYPE(a, 1, AWLVAL_QEXPR, fname);
+
+    awlval* parts = par_chunks(e, a->cell[0], a->cell[1], NULL, chunk);
+    awlval_del(a);
+    if (parts->type == AWLVAL_ERR) {
+        return parts;
+    }
+
+    awlval* acc = awlval_qexpr();
+    while (parts->count > 0) {
+        acc = awlval_join(acc, awlval_pop(parts, 0));
+    }
+    awlval_del(parts);
+    return acc;
+}
+
+awlval* builtin_pmap(awlenv* e, awlval* a) {
+    BUILTIN_PARTIAL(e, a, builtin_pmap, "pmap", "f", "l");
+    return builtin_par_join(e, a, "pmap", map_chunk);
+}
+
+awlval* builtin_pfilter(awlenv* e, awlval* a) {
+    BUILTIN_PARTIAL(e, a, builtin_pfilter, "pfilter", "f", "l");
+    return builtin_par_join(e, a, "pfilter", filter_chunk);
+}
+
+awlval* builtin_preduce(awlenv* e, awlval* a) {
+    BUILTIN_PARTIAL(e, a, builtin_preduce, "preduce", "f", "l", "acc");
+    AWLASSERT_ARGCOUNT(a, 3, "preduce");
+    EVAL_ARGS(e, a);
+    AWLASSERT_ISCALLABLE(a, 0, "preduce");
+    AWLASSERT_TYPE(a, 1, AWLVAL_QEXPR, "preduce");
+
+    /* each chunk is reduced from acc, so it must be an identity of f */
+    awlval* f = a->cell[0];
+    awlval* parts = par_chunks(e, f, a->cell[1], a->cell[2], reduce_chunk);
+    if (parts->type != AWLVAL_ERR && parts->count == 0) {
+        parts = awlval_add(parts, awlval_retain(a->cell[2]));
+    }
+
+    /* neighbouring results are combined until one is left, in a tree
+     * shaped by the number of chunks alone; as in reduce, the later of
+     * the two is passed first */
+    while (parts->type != AWLVAL_ERR && parts->count > 1) {
+        awlval* next = awlval_qexpr();
+        for (int i = 0; i < parts->count; i += 2) {
+            awlval* x = awlval_retain(parts->cell[i]);
+            if (i + 1 < parts->count) {
+                awlval* args = awlval_add(awlval_sexpr(), awlval_retain(parts->cell[i + 1]));
+                x = awlval_apply(e, awlval_retain(f), awlval_add(args, x));
+            }
+            if (x->type == AWLVAL_ERR) {
+                awlval_del(next);
+                next = x;
+                break;
+            }
+            next = awlval_add(next, x);
+        }
+        awlval_del(parts);
+        parts = next;
+    }
+
+    awlval_del(a);
+    return parts->type == AWLVAL_ERR ? parts : awlval_take(parts, 0);
+}
+
+/* stops at the first result that decides the whole */
+static awlval* builtin_quantify(awlenv* e, awlval* a, bool any) {
+    const char* fname = any ? "any" : "all";
+    AWLASSERT_ARGCOUNT(a, 2, fname);
+    EVAL_ARGS(e, a);
+    AWLASSERT_ISCALLABLE(a, 0, fname);
+    AWLASSERT_TYPE(a, 1, AWLVAL_QEXPR, fname);
+
+    awlval* f = a->cell[0];
+    awlval* l = a->cell[1];
+    awlval* result = awlval_bool(!any);
+    for (int i = l->count - 1; i >= 0; i--) {
+        awlval* x = list_elem(e, l, i);
+        if (x->type != AWLVAL_ERR) {
+            x = apply_predicate(e, f, x, fname);
+        }
+        if (x->type == AWLVAL_ERR || x->bln == any) {
+            awlval_del(result);
+            result = x;
+            break;
+        }
+        awlval_del(x);
+    }
+
+    awlval_del(a);
+    return result;
+}
+
+awlval* builtin_any(awlenv* e, awlval* a) {
+    BUILTIN_PARTIAL(e, a, builtin_any, "any", "f", "l");
+    return builtin_quantify(e, a, true);
+}
+
+awlval* builtin_all(awlenv* e, awlval* a) {
+    BUILTIN_PARTIAL(e, a, builtin_all, "all", "f", "l");
+    return builtin_quantify(e, a, false);
+}
+
+/* folds the list with a single call to the operator's kernel, which sees
+ * the operands in the order the right fold from the identity would */
+static awlval* builtin_fold_num(awlenv* e, awlval* a, awlnum_op op, long identity, const char* fname) {
+    AWLASSERT_ARGCOUNT(a, 1, fname);
+    EVAL_ARGS(e, a);
+    AWLASSERT_TYPE(a, 0, AWLVAL_QEXPR, fname);
+
+    awlval* l = a->cell[0];
+    awlval* args = awlval_add(awlval_sexpr(), awlval_int(identity));
+    for (int i = l->count - 1; i >= 0; i--) {
+        awlval* x = list_elem(e, l, i);
+        if (x->type == AWLVAL_ERR) {
+            awlval_del(args);
+            awlval_del(a);
+            return x;
+        }
+        args = awlval_add(args, x);
+    }
+
+    awlval_del(a);
+    args->evaluated = true;
+    return builtin_num_op(e, args, op);
+}
+
+awlval* builtin_sum(awlenv* e, awlval* a) {
+    BUILTIN_PARTIAL(e, a, builtin_sum, "sum", "l");
+    return builtin_fold_num(e, a, AWLNUM_ADD, 0, "sum");
+}
+
+awlval* builtin_product(awlenv* e, awlval* a) {
+    BUILTIN_PARTIAL(e, a, builtin_product, "product", "l");
+    return builtin_fold_num(e, a, AWLNUM_MUL, 1, "product");
+}
+
+awlval* builtin_zip(awlenv* e, awlval* a) {
+    EVAL_ARGS(e, a);
+
+    /* as long as the shortest list */
+    int n = a->count ? INT_MAX : 0;
+    for (int i = 0; i < a->count; i++) {
+        AWLASSERT_TYPE(a, i, AWLVAL_QEXPR, "zip");
+        if (a->cell[i]->count < n) {
+            n = a->cell[i]->count;
+        }
+    }
+
+    awlval* x = awlval_qexpr();
+    for (int j = 0; j < n; j++) {
+        awlval* t = awlval_qexpr();
+        for (int i = a->count - 1; i >= 0; i--) {
+            awlval* y = list_elem(e, a->cell[i], j);
+            if (y->type == AWLVAL_ERR) {
+                awlval_del(t);
+                awlval_del(x);
+                awlval_del(a);
+                return y;
+            }
+            awlval_add_front(t, y);
+        }
+        x = awlval_add(x, t);
+    }
+
+    awlval_del(a);
+    return x;
+}
+
+awlval* builtin_member(awlenv* e, awlval* a) {
+    BUILTIN_PARTIAL(e, a, builtin_member, "member?", "x", "l");
+    AWLASSERT_ARGCOUNT(a, 2, "member?");
+    EVAL_ARGS(e, a);
+    AWLASSERT_TYPE(a, 1, AWLVAL_QEXPR, "member?");
+
+    awlval* l = a->cell[1];
+    bool found = false;
+    for (int i = 0; i < l->count && !found; i++) {
+        awlval* y = list_elem(e, l, i);
+        if (y->type == AWLVAL_ERR) {
+            awlval_del(a);
+            return y;
+        }
+        found = awlval_eq(a->cell[0], y);
+        awlval_del(y);
+    }
+
+    awlval_del(a);
+    return awlval_bool(found);
+}
+
+awlval* builtin_range(awlenv* e, awlval* a) {
+    BUILTIN_PARTIAL(e, a, builtin_range, "range", "s", "e");
+    AWLASSERT_ARGCOUNT(a, 2, "range");
+    EVAL_ARGS(e, a);
+    AWLASSERT_ISNUMERIC(a, 0, "range");
+    AWLASSERT_ISNUMERIC(a, 1, "range");
+
+    /* counts up by one from s, which keeps its type */
+    awlval* s = a->cell[0];
+    awlval* end = a->cell[1];
+    awlval* x = awlval_qexpr();
+    if (s->type == AWLVAL_INT && end->type == AWLVAL_INT) {
+        for (long i = s->lng; i < end->lng; i++) {
+            x = awlval_add(x, awlval_int(i));
+        }
+    } else if (s->type == AWLVAL_INT) {
+        for (long i = s->lng; (double)i < end->dbl; i++) {
+            x = awlval_add(x, awlval_int(i));
+        }
+    } else {
+        double stop = end->type == AWLVAL_FLOAT ? end->dbl : (double)end->lng;
+        for (double d = s->dbl; d < stop; d += 1.0) {
+            x = awlval_add(x, awlval_float(d));
+        }
+    }
+
+    awlval_del(a);
+    return x;
+}
+
 awlval* builtin_if(awlenv* e, awlval* a) {
     AWLASSERT_ARGCOUNT(a, 3, "if");
 
@@ -634,6 +1099,20 @@ awlval* builtin_if(awlenv* e, awlval* a) {
     return x;
 }
 
+awlval* builtin_do(awlenv* e, awlval* a) {
+    if (a->count == 0) {
+        awlval_del(a);
+        return awlval_qexpr();
+    }
+
+    for (int i = 0; i < a->count - 1; i++) {
+        EVAL_SINGLE_ARG(e, a, i);
+    }
+
+    /* as with if, the last is left to awlval_eval */
+    return awlval_take(a, a->count - 1);
+}
+
 awlval* builtin_var(awlenv* e, awlval* a, bool global) {
     char* op = global ? "global" : "define";
     AWLASSERT_MINARGCOUNT(a, 2, op);
@@ -647,6 +1126,8 @@ awlval* builtin_var(awlenv* e, awlval* a, bool global) {
                 "cannot redefine '%s'", a->cell[0]->sym);
 
         EVAL_SINGLE_ARG(e, a, 1);
+        AWLASSERT(a, !awlenv_frozen(e, global),
+                "function '%s' cannot bind outside the function of a parallel call", op);
 
         if (global) {
             awlenv_put_global(e, a->cell[0], a->cell[1]);
@@ -678,6 +1159,8 @@ awlval* builtin_var(awlenv* e, awlval* a, bool global) {
     for (int i = 1; i < a->count; i++) {
         EVAL_SINGLE_ARG(e, a, i);
     }
+    AWLASSERT(a, !awlenv_frozen(e, global),
+            "function '%s' cannot bind outside the function of a parallel call", op);
 
     for (int i = 0; i < syms->count; i++) {
         if (global) {
@@ -703,6 +1186,8 @@ awlval* builtin_let(awlenv* e, awlval* a) {
     AWLASSERT_ARGCOUNT(a, 2, "let");
     AWLASSERT_TYPE(a, 0, AWLVAL_SEXPR, "let");
 
+    /* bindings are evaluated in place */
+    a->cell[0] = awlval_unshare(a->cell[0]);
     awlval* bindings = a->cell[0];
     /* verify structure of inner bindings list */
     for (int i = 0; i < bindings->count; i++) {
@@ -721,20 +1206,18 @@ awlval* builtin_let(awlenv* e, awlval* a) {
                 "cannot redefine '%s'", bindings->cell[i]->cell[0]->sym);
     }
 
-    // TODO: Because of reference cycles, this causes garbage to build up
-    // Need to add GC
     awlenv* lenv = awlenv_new();
     lenv->parent = e;
     lenv->parent->references++;
 
     /* Evaluate value arguments (but not the symbols) */
     for (int i = 0; i < bindings->count; i++) {
+        bindings->cell[i] = awlval_unshare(bindings->cell[i]);
         bindings->cell[i] = awlval_eval_arg(lenv, bindings->cell[i], 1);
 
         if (bindings->cell[i]->type == AWLVAL_ERR) {
             awlval* err = awlval_pop(bindings, i);
             awlval_del(a);
-            lenv->parent = NULL;
             awlenv_del(lenv);
             return err;
         }
@@ -745,15 +1228,16 @@ awlval* builtin_let(awlenv* e, awlval* a) {
         awlenv_put(lenv, sym, val);
     }
 
-    awlval* v = awlval_eval(lenv, awlval_take(a, 1));
-
-    awlenv_del(lenv);
-    return v;
+    /* does not eval the body; sends it back to awlval_eval to run in the
+     * new frame, so that a call in tail position stays one */
+    return awlval_body(lenv, awlval_take(a, 1));
 }
 
 awlval* builtin_lambda(awlenv* e, awlval* a) {
     AWLASSERT_ARGCOUNT(a, 2, "fn");
     AWLASSERT_ISEXPR(a, 0, "fn");
+    AWLASSERT(a, a->cell[0]->count <= AWLVAL_MAX_FORMALS,
+            "function 'fn' cannot take more than %i arguments", AWLVAL_MAX_FORMALS);
 
     for (int i = 0; i < a->cell[0]->count; i++) {
         AWLASSERT(a, (a->cell[0]->cell[i]->type == AWLVAL_SYM),
@@ -773,11 +1257,15 @@ awlval* builtin_macro(awlenv* e, awlval* a) {
     int index = awlenv_index(e, a->cell[0]);
     AWLASSERT(a, index == -1,
             "cannot redefine '%s'", a->cell[0]->sym);
+    AWLASSERT(a, a->cell[1]->count <= AWLVAL_MAX_FORMALS,
+            "macro cannot take more than %i arguments", AWLVAL_MAX_FORMALS);
 
     for (int i = 0; i < a->cell[1]->count; i++) {
         AWLASSERT(a, (a->cell[1]->cell[i]->type == AWLVAL_SYM),
                 "macro cannot take non-symbol argument at position %i", i);
     }
+    AWLASSERT(a, !awlenv_frozen(e, false),
+            "function '%s' cannot bind outside the function of a parallel call", "macro");
 
     awlval* name = awlval_pop(a, 0);
     awlval* formals = awlval_pop(a, 0);
@@ -830,8 +1318,9 @@ awlval* builtin_import(awlenv* e, awlval* a) {
     AWLASSERT_TYPE(a, 0, AWLVAL_STR, "import");
 
     // Check the import path
-    char* importPath = safe_malloc(strlen(a->cell[0]->str) + 5); // extra space for extension
-    strcpy(importPath, a->cell[0]->str);
+    const char* path = awlval_str_cstr(a->cell[0]);
+    char* importPath = safe_malloc(strlen(path) + 5); // extra space for extension
+    strcpy(importPath, path);
     strcat(importPath, ".awl");
 
     // Attempt twice: once with the .awl extension, and once with the raw path
@@ -850,15 +1339,15 @@ awlval* builtin_import(awlenv* e, awlval* a) {
 
             // Try the raw path if we have once more attempt
             if (attempt == 0) {
-                importPath = safe_malloc(strlen(a->cell[0]->str) + 1);
-                strcpy(importPath, a->cell[0]->str);
+                importPath = safe_malloc(strlen(path) + 1);
+                strcpy(importPath, path);
             } else {
                 // Return error otherwise
                 awlval* errval;
                 if (statErr && errno == ENOENT) {
-                    errval = awlval_err("path '%s' does not exist", a->cell[0]->str);
+                    errval = awlval_err("path '%s' does not exist", path);
                 } else if (!S_ISREG(s.st_mode)) {
-                    errval = awlval_err("path '%s' is not a regular file", a->cell[0]->str);
+                    errval = awlval_err("path '%s' is not a regular file", path);
                 } else {
                     errval = awlval_err("unknown import error");
                 }
@@ -874,7 +1363,7 @@ awlval* builtin_import(awlenv* e, awlval* a) {
         free(importPath);
 
         while (v->count) {
-            awlval* x = awlval_eval(e, awlval_pop(v, 0));
+            awlval* x = vm_eval_top(e, awlval_pop(v, 0));
             if (x->type == AWLVAL_ERR) {
                 awlval_println(x);
             }
@@ -903,7 +1392,7 @@ awlval* builtin_print(awlenv* e, awlval* a) {
             awl_printf(" ");
         }
         if (a->cell[i]->type == AWLVAL_STR) {
-            awl_printf("%s", a->cell[i]->str);
+            awl_printf("%.*s", a->cell[i]->length, a->cell[i]->str);
         } else {
             awlval_print(a->cell[i]);
         }
@@ -920,8 +1409,8 @@ awlval* builtin_println(awlenv* e, awlval* a) {
 
 awlval* builtin_random(awlenv* e, awlval* a) {
     AWLASSERT_ARGCOUNT(a, 0, "random");
-    double r = (double)rand() / (double)RAND_MAX;
-    return awlval_float(r);
+    awlval_del(a);
+    return awlval_float(awl_runtime_random(awl_rt));
 }
 
 awlval* builtin_error(awlenv* e, awlval* a) {
@@ -929,13 +1418,144 @@ awlval* builtin_error(awlenv* e, awlval* a) {
     EVAL_ARGS(e, a);
     AWLASSERT_TYPE(a, 0, AWLVAL_STR, "error");
 
-    awlval* err = awlval_err(a->cell[0]->str);
+    awlval* err = awlval_err(awlval_str_cstr(a->cell[0]));
     awlval_del(a);
     return err;
 }
 
+awlval* builtin_gc(awlenv* e, awlval* a) {
+    AWLASSERT_ARGCOUNT(a, 0, "gc");
+    awlval_del(a);
+    return awlval_int(gc_collect());
+}
+
+static void gc_stats_add(awlval* d, const char* name, awlval* v) {
+    awlval* k = awlval_qsym(name);
+    awlval_add_dict(d, k, v);
+    awlval_del(k);
+    awlval_del(v);
+}
+
+awlval* builtin_gcstats(awlenv* e, awlval* a) {
+    AWLASSERT_ARGCOUNT(a, 0, "gc-stats");
+    awlval_del(a);
+
+    gc_stats_t stats = gc_get_stats();
+    awlval* d = awlval_dict();
+    gc_stats_add(d, "collections", awlval_int(stats.collections));
+    gc_stats_add(d, "freed", awlval_int(stats.freed));
+    gc_stats_add(d, "live", awlval_int(stats.live));
+    gc_stats_add(d, "threshold", awlval_int(stats.threshold));
+    gc_stats_add(d, "last-pause", awlval_float(stats.last_pause));
+    gc_stats_add(d, "max-pause", awlval_float(stats.max_pause));
+    gc_stats_add(d, "total-pause", awlval_float(stats.total_pause));
+    return d;
+}
+
 awlval* builtin_exit(awlenv* e, awlval* a) {
     awlval_del(a);
     abort_repl();
     return awlval_qexpr();
 }
+
+awlval* builtin_spawn(awlenv* e, awlval* a) {
+    AWLASSERT_MINARGCOUNT(a, 1, "spawn");
+    EVAL_ARGS(e, a);
+    AWLASSERT_ISCALLABLE(a, 0, "spawn");
+
+    awlval* f = awlval_pop(a, 0);
+    return sched_spawn(e, f, a);
+}
+
+awlval* builtin_yield(awlenv* e, awlval* a) {
+    AWLASSERT_RANGEARGCOUNT(a, 0, 1, "yield");
+    EVAL_ARGS(e, a);
+
+    /* with a value, the running generator yields it; without, the task
+     * lets the others run */
+    awlval* err = a->count ? awlgen_yield(awlval_pop(a, 0)) : sched_yield();
+    awlval_del(a);
+    return err ? err : awlval_qexpr();
+}
+
+awlval* builtin_chan(awlenv* e, awlval* a) {
+    AWLASSERT_ARGCOUNT(a, 0, "chan");
+    awlval_del(a);
+    return awlval_chan();
+}
+
+awlval* builtin_send(awlenv* e, awlval* a) {
+    AWLASSERT_ARGCOUNT(a, 2, "send");
+    EVAL_ARGS(e, a);
+    AWLASSERT_TYPE(a, 0, AWLVAL_CHAN, "send");
+
+    sched_send(a->cell[0]->chan, awlval_pop(a, 1));
+    awlval_del(a);
+    return awlval_qexpr();
+}
+
+awlval* builtin_recv(awlenv* e, awlval* a) {
+    AWLASSERT_ARGCOUNT(a, 1, "recv");
+    EVAL_ARGS(e, a);
+    AWLASSERT_TYPE(a, 0, AWLVAL_CHAN, "recv");
+
+    awlval* x = sched_recv(a->cell[0]->chan);
+    awlval_del(a);
+    return x;
+}
+
+awlval* builtin_generator(awlenv* e, awlval* a) {
+    AWLASSERT_MINARGCOUNT(a, 1, "generator");
+    EVAL_ARGS(e, a);
+    AWLASSERT_ISCALLABLE(a, 0, "generator");
+
+    awlval* f = awlval_pop(a, 0);
+    return awlval_gen(e, f, a);
+}
+
+awlval* builtin_next(awlenv* e, awlval* a) {
+    AWLASSERT_ARGCOUNT(a, 1, "next");
+    EVAL_ARGS(e, a);
+    AWLASSERT_TYPE(a, 0, AWLVAL_GEN, "next");
+
+    /* a finished generator gives nil, like nth past the end of a list */
+    awlval* x = awlgen_next(a->cell[0]->gen);
+    awlval_del(a);
+    return x ? x : awlval_qexpr();
+}
+
+awlval* builtin_done(awlenv* e, awlval* a) {
+    AWLASSERT_ARGCOUNT(a, 1, "done?");
+    EVAL_ARGS(e, a);
+    AWLASSERT_TYPE(a, 0, AWLVAL_GEN, "done?");
+
+    bool done = awlgen_done(a->cell[0]->gen);
+    awlval_del(a);
+    return awlval_bool(done);
+}
+
+awlval* builtin_gentake(awlenv* e, awlval* a) {
+    AWLASSERT_ARGCOUNT(a, 2, "gen-take");
+    EVAL_ARGS(e, a);
+    AWLASSERT_TYPE(a, 0, AWLVAL_INT, "gen-take");
+    AWLASSERT_TYPE(a, 1, AWLVAL_GEN, "gen-take");
+
+    /* fewer if the generator finishes first */
+    awlgen* g = a->cell[1]->gen;
+    awlval* x = awlval_qexpr();
+    for (long i = 0; i < a->cell[0]->lng; i++) {
+        awlval* v = awlgen_next(g);
+        if (!v) {
+            break;
+        }
+        if (v->type == AWLVAL_ERR) {
+            awlval_del(x);
+            x = v;
+            break;
+        }
+        x = awlval_add(x, v);
+    }
+
+    awlval_del(a);
+    return x;
+}
@@ -4,8 +4,32 @@
 #include <stdbool.h>
 #include "types.h"
 
+/* Operators of the arithmetic, ordering and equality builtins; each has
+ * its own kernel rather than being told apart by name per operand */
+typedef enum {
+    AWLNUM_ADD,
+    AWLNUM_SUB,
+    AWLNUM_MUL,
+    AWLNUM_DIV,
+    AWLNUM_TRUNC_DIV,
+    AWLNUM_MOD,
+    AWLNUM_POW
+} awlnum_op;
+
+typedef enum {
+    AWLORD_GT,
+    AWLORD_GTE,
+    AWLORD_LT,
+    AWLORD_LTE
+} awlord_op;
+
+typedef enum {
+    AWLLOGIC_EQ,
+    AWLLOGIC_NEQ
+} awllogic_op;
+
 /* language builtins */
-awlval* builtin_num_op(awlenv* e, awlval* a, char* op);
+awlval* builtin_num_op(awlenv* e, awlval* a, awlnum_op op);
 awlval* builtin_add(awlenv* e, awlval* a);
 awlval* builtin_sub(awlenv* e, awlval* a);
 awlval* builtin_mul(awlenv* e, awlval* a);
@@ -14,13 +38,13 @@ awlval* builtin_trunc_div(awlenv* e, awlval* a);
 awlval* builtin_mod(awlenv* e, awlval* a);
 awlval* builtin_pow(awlenv* e, awlval* a);
 
-awlval* builtin_ord_op(awlenv* e, awlval* a, char* op);
+awlval* builtin_ord_op(awlenv* e, awlval* a, awlord_op op);
 awlval* builtin_gt(awlenv* e, awlval* a);
 awlval* builtin_gte(awlenv* e, awlval* a);
 awlval* builtin_lt(awlenv* e, awlval* a);
 awlval* builtin_lte(awlenv* e, awlval* a);
 
-awlval* builtin_logic_op(awlenv* e, awlval* a, char* op);
+awlval* builtin_logic_op(awlenv* e, awlval* a, awllogic_op op);
 awlval* builtin_eq(awlenv* e, awlval* a);
 awlval* builtin_neq(awlenv* e, awlval* a);
 
@@ -50,7 +74,22 @@ awlval* builtin_len(awlenv* e, awlval* a);
 awlval* builtin_reverse(awlenv* e, awlval* a);
 awlval* builtin_slice(awlenv* e, awlval* a);
 
+awlval* builtin_reduce(awlenv* e, awlval* a);
+awlval* builtin_map(awlenv* e, awlval* a);
+awlval* builtin_filter(awlenv* e, awlval* a);
+awlval* builtin_pmap(awlenv* e, awlval* a);
+awlval* builtin_pfilter(awlenv* e, awlval* a);
+awlval* builtin_preduce(awlenv* e, awlval* a);
+awlval* builtin_any(awlenv* e, awlval* a);
+awlval* builtin_all(awlenv* e, awlval* a);
+awlval* builtin_sum(awlenv* e, awlval* a);
+awlval* builtin_product(awlenv* e, awlval* a);
+awlval* builtin_zip(awlenv* e, awlval* a);
+awlval* builtin_member(awlenv* e, awlval* a);
+awlval* builtin_range(awlenv* e, awlval* a);
+
 awlval* builtin_if(awlenv* e, awlval* a);
+awlval* builtin_do(awlenv* e, awlval* a);
 awlval* builtin_var(awlenv* e, awlval* a, bool global);
 awlval* builtin_define(awlenv* e, awlval* a);
 awlval* builtin_global(awlenv* e, awlval* a);
@@ -66,6 +105,18 @@ awlval* builtin_print(awlenv* e, awlval* a);
 awlval* builtin_println(awlenv* e, awlval* a);
 awlval* builtin_random(awlenv* e, awlval* a);
 awlval* builtin_error(awlenv* e, awlval* a);
+awlval* builtin_gc(awlenv* e, awlval* a);
+awlval* builtin_gcstats(awlenv* e, awlval* a);
 awlval* builtin_exit(awlenv* e, awlval* a);
 
+awlval* builtin_spawn(awlenv* e, awlval* a);
+awlval* builtin_yield(awlenv* e, awlval* a);
+awlval* builtin_chan(awlenv* e, awlval* a);
+awlval* builtin_send(awlenv* e, awlval* a);
+awlval* builtin_recv(awlenv* e, awlval* a);
+awlval* builtin_generator(awlenv* e, awlval* a);
+awlval* builtin_next(awlenv* e, awlval* a);
+awlval* builtin_done(awlenv* e, awlval* a);
+awlval* builtin_gentake(awlenv* e, awlval* a);
+
 #endif
@@ -3,6 +3,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "intern.h"
+#include "pool.h"
 #include "util.h"
 
 #define DICT_INITIAL_SIZE 16
@@ -32,45 +34,45 @@ dict* dict_new(const copy_fn copier, const del_fn deleter) {
 }
 
 dict* dict_new_no_bindings(void) {
-    dict* d = safe_malloc(sizeof(dict));
+    dict* d = pool_alloc(sizeof(dict));
+    d->refs = 1;
     d->size = DICT_INITIAL_SIZE;
     d->count = 0;
-    d->syms = safe_malloc(sizeof(char*) * DICT_INITIAL_SIZE);
+    d->syms = pool_alloc(sizeof(char*) * DICT_INITIAL_SIZE);
     for (int i = 0; i < DICT_INITIAL_SIZE; i++) {
         d->syms[i] = NULL;
     }
-    d->vals = safe_malloc(sizeof(void*) * DICT_INITIAL_SIZE);
+    d->vals = pool_alloc(sizeof(void*) * DICT_INITIAL_SIZE);
     d->copier = NULL;
     d->deleter = NULL;
     return d;
 }
 
+dict* dict_retain(dict* d) {
+    d->refs++;
+    return d;
+}
+
 void dict_del(dict* d) {
+    if (--d->refs > 0) {
+        return;
+    }
+
     for (int i = 0; i < d->size; i++) {
         if (d->syms[i]) {
-            free(d->syms[i]);
+            intern_release(d->syms[i]);
             maybe_delete(d, d->vals[i]);
         }
     }
-    free(d->syms);
-    free(d->vals);
-    free(d);
-}
-
-static unsigned int dict_hash(const char* str) {
-    /* djb2 hash */
-    unsigned int hash = 5381;
-    for (int i = 0; str[i]; i++) {
-        /* XOR hash * 33 with current char val */
-        hash = ((hash << 5) + hash) ^ str[i];
-    }
-    return hash;
+    pool_free(d->syms, sizeof(char*) * d->size);
+    pool_free(d->vals, sizeof(void*) * d->size);
+    pool_free(d, sizeof(dict));
 }
 
 static int dict_findslot(const dict* d, const char* k) {
-    unsigned int i = dict_hash(k) % d->size;
+    unsigned int i = intern_hash(k) % d->size;
     unsigned int probe = 1;
-    while (d->syms[i] && !streq(d->syms[i], k)) {
+    while (d->syms[i] && d->syms[i] != k) {
         i = (i + probe) % d->size;
         probe += DICT_PROBE_INTERVAL;
     }
@@ -105,8 +107,7 @@ static void dict_set(dict* d, const char* k, void* v) {
         dict_resize(d);
         i = dict_findslot(d, k);
     }
-    d->syms[i] = safe_malloc(strlen(k) + 1);
-    strcpy(d->syms[i], k);
+    d->syms[i] = intern_retain(k);
     d->vals[i] = maybe_copy(d, v);
 }
 
@@ -117,22 +118,22 @@ static void dict_resize(dict* d) {
     char** syms = d->syms;
     void** vals = d->vals;
 
-    d->syms = safe_malloc(sizeof(char*) * d->size);
+    d->syms = pool_alloc(sizeof(char*) * d->size);
     for (int i = 0; i < d->size; i++) {
         d->syms[i] = NULL;
     }
-    d->vals = safe_malloc(sizeof(void*) * d->size);
+    d->vals = pool_alloc(sizeof(void*) * d->size);
 
     for (int i = 0; i < oldsize; i++) {
         if (syms[i]) {
-            dict_set(d, syms[i], vals[i]);
-
-            free(syms[i]);
-            maybe_delete(d, vals[i]);
+            /* keys are interned, so entries move over as they are */
+            int j = dict_findslot(d, syms[i]);
+            d->syms[j] = syms[i];
+            d->vals[j] = vals[i];
         }
     }
-    free(syms);
-    free(vals);
+    pool_free(syms, sizeof(char*) * oldsize);
+    pool_free(vals, sizeof(void*) * oldsize);
 }
 
 int dict_index(const dict* d, const char* k) {
@@ -159,27 +160,28 @@ void dict_rm(dict* d, const char* k) {
     int i = dict_findslot(d, k);
     if (d->syms[i]) {
         d->count--;
+        intern_release(d->syms[i]);
         maybe_delete(d, d->vals[i]);
-        free(d->syms[i]);
         d->syms[i] = NULL;
     }
 }
 
 dict* dict_copy(const dict* d) {
-    dict* n = safe_malloc(sizeof(dict));
+    dict* n = pool_alloc(sizeof(dict));
+    n->refs = 1;
     n->size = d->size;
-    n->count = 0;
+    n->count = d->count;
     n->copier = d->copier;
     n->deleter = d->deleter;
-    n->syms = safe_malloc(sizeof(char*) * d->size);
-    for (int i = 0; i < d->size; i++) {
-        n->syms[i] = NULL;
-    }
-    n->vals = safe_malloc(sizeof(void*) * d->size);
 
+    /* same size, so every entry keeps its slot */
+    n->syms = pool_alloc(sizeof(char*) * d->size);
+    memcpy(n->syms, d->syms, sizeof(char*) * d->size);
+    n->vals = pool_alloc(sizeof(void*) * d->size);
     for (int i = 0; i < d->size; i++) {
         if (d->syms[i]) {
-            dict_set(n, d->syms[i], d->vals[i]);
+            intern_retain(d->syms[i]);
+            n->vals[i] = maybe_copy(d, d->vals[i]);
         }
     }
 
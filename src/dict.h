@@ -6,7 +6,11 @@
 typedef void*(*copy_fn)(const void*);
 typedef void(*del_fn)(void*);
 
+/* Keys are interned names (see intern.h) and are compared by pointer.
+ * A dict may be shared by several holders (see dict_retain); it must be
+ * copied before it is modified while refs > 1 */
 typedef struct dict {
+    int refs;
     int size;
     int count;
     char** syms;
@@ -17,6 +21,7 @@ typedef struct dict {
 
 dict* dict_new(const copy_fn copier, const del_fn deleter);
 dict* dict_new_no_bindings(void);
+dict* dict_retain(dict* d);
 void dict_del(dict* d);
 int dict_index(const dict* d, const char* k);
 void* dict_get(const dict* d, const char* k);
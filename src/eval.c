@@ -2,9 +2,21 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
+#include <sys/resource.h>
 #include "builtins.h"
+#include "fold.h"
+#include "gc.h"
+#include "sched.h"
 #include "util.h"
+#include "vm.h"
+
+#define EXPANSIONS_INITIAL_SIZE 64
+#define EVAL_SCAN_LOCAL_SIZE 32
+/* recursion through a builtin nests a few levels for each function the
+ * builtin applies, and a share of those past this is mostly builtins */
+#define EVAL_APPLY_SHARE 8
 
 #define AWLENV_DEL_RECURSING(e) { \
     if (recursing) { \
@@ -12,25 +24,122 @@
     } \
 }
 
-static bool eval_aborted = false;
+static _Thread_local long max_depth = AWL_MAX_DEPTH;
+static _Thread_local long depth = 0;
+static _Thread_local long applying = 0;
+
+/* where the outermost evaluation of the running task started on its C
+ * stack, and how far below that the tree walker may go */
+static _Thread_local uintptr_t stack_base = 0;
+static _Thread_local size_t stack_budget = 0;
+
+void awlval_eval_set_max_depth(long d) {
+    max_depth = d > 0 ? d : AWL_MAX_DEPTH;
+}
+
+long awlval_eval_max_depth(void) {
+    return max_depth;
+}
+
+static size_t eval_stack_budget(void) {
+    size_t size = AWL_STACK_SIZE;
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_STACK, &limit) == 0) {
+        size = limit.rlim_cur == RLIM_INFINITY ? AWL_UNLIMITED_STACK_SIZE : limit.rlim_cur;
+    }
+
+    /* leave a quarter for whatever the deepest evaluation calls into */
+    return size / 4 * 3;
+}
+
+static awlval* awlval_eval_descend_checked(uintptr_t sp) {
+    if (depth == 0) {
+        stack_base = sp;
+        if (!stack_budget) {
+            stack_budget = eval_stack_budget();
+        }
+    }
+
+    if (depth >= max_depth) {
+        return awlval_err("maximum recursion depth of %li exceeded", max_depth);
+    }
+    if ((stack_base > sp ? stack_base - sp : sp - stack_base) > stack_budget) {
+        /* the VM would only help if few of the levels are builtins
+         * calling back into evaluation */
+        if (!vm_enabled() && applying * EVAL_APPLY_SHARE < depth) {
+            return awlval_err("maximum recursion depth exceeded; out of C stack (--vm recurses on the heap)");
+        }
+        return awlval_err("maximum recursion depth exceeded; out of C stack");
+    }
+    depth++;
+    return NULL;
+}
 
-void awlval_eval_abort(void) {
-    eval_aborted = true;
+eval_depth_t awlval_eval_depth_new(size_t stack_size) {
+    eval_depth_t d = { 0, 0, 0, stack_size / 4 * 3 };
+    return d;
+}
+
+eval_depth_t awlval_eval_depth_swap(eval_depth_t d) {
+    eval_depth_t old = { depth, applying, stack_base, stack_budget };
+    depth = d.depth;
+    applying = d.applying;
+    stack_base = d.stack_base;
+    stack_budget = d.stack_budget;
+    return old;
+}
+
+awlval* awlval_eval_descend(void) {
+    /* the stack grows down from where the outermost evaluation started */
+    uintptr_t sp = (uintptr_t)__builtin_frame_address(0);
+    if (depth > 0 && depth < max_depth && stack_base - sp <= stack_budget) {
+        depth++;
+        return NULL;
+    }
+    return awlval_eval_descend_checked(sp);
+}
+
+void awlval_eval_ascend(void) {
+    depth--;
+}
+
+void awlval_eval_preempt(void) {
+    atomic_store(&awl_rt->eval_preempted, 1);
+    atomic_store(&awl_rt->eval_pending, 1);
+}
+
+awlval* awlval_eval_safe_point(void) {
+    atomic_store(&awl_rt->eval_pending, 0);
+    if (atomic_exchange(&awl_rt->eval_preempted, 0)) {
+        awlval* err = sched_yield();
+        if (err) {
+            return err;
+        }
+    }
+
+    if (atomic_exchange(&awl_rt->eval_aborted, 0)) {
+        return awlval_err("eval aborted");
+    }
+    return NULL;
 }
 
 awlval* awlval_eval(awlenv* e, awlval* v) {
     bool recursing = false;
 
     while (true) {
-        // Handle abort
-        if (eval_aborted) {
-            AWLENV_DEL_RECURSING(e);
-            awlval_del(v);
-
-            eval_aborted = false;
-            return awlval_err("eval aborted");
+        /* abort, or let other tasks run */
+        if (awlval_eval_pending()) {
+            awlval* err = awlval_eval_safe_point();
+            if (err) {
+                AWLENV_DEL_RECURSING(e);
+                awlval_del(v);
+                return err;
+            }
         }
 
+        /* every frame above owns what it holds, so this is a safe point */
+        gc_maybe_collect();
+
         switch (v->type) {
             case AWLVAL_SYM:
             {
@@ -50,8 +159,17 @@ awlval* awlval_eval(awlenv* e, awlval* v) {
                     AWLENV_DEL_RECURSING(e);
                     recursing = true;
 
-                    e = awlenv_copy(x->env);
-                    v = awlval_copy(x->body);
+                    /* a frame made for this call alone is run in directly,
+                     * even when closures made as it was bound hold it too,
+                     * as in a let; only a call that may run again needs a
+                     * copy */
+                    if (x->refs == 1) {
+                        e = x->env;
+                        e->references++;
+                    } else {
+                        e = awlenv_copy(x->env);
+                    }
+                    v = awlval_retain(x->body);
 
                     awlval_del(x);
                 } else {
@@ -88,6 +206,10 @@ awlval* awlval_eval(awlenv* e, awlval* v) {
 }
 
 awlval* awlval_eval_arg(awlenv* e, awlval* v, int arg) {
+    if (v->evaluated) {
+        return v;
+    }
+
     v->cell[arg] = awlval_eval(e, v->cell[arg]);
     if (v->cell[arg]->type == AWLVAL_ERR) {
         return awlval_take(v, arg);
@@ -96,6 +218,11 @@ awlval* awlval_eval_arg(awlenv* e, awlval* v, int arg) {
 }
 
 awlval* awlval_eval_args(awlenv* e, awlval* v) {
+    if (v->evaluated) {
+        v->evaluated = false;
+        return v;
+    }
+
     for (int i = 0; i < v->count; i++) {
         v->cell[i] = awlval_eval(e, v->cell[i]);
     }
@@ -114,22 +241,175 @@ awlval* awlval_eval_sexpr(awlenv* e, awlval* v) {
         return awlval_err("cannot evaluate empty %s", awlval_type_name(AWLVAL_SEXPR));
     }
 
-    EVAL_SINGLE_ARG(e, v, 0);
+    if (v->folded && awlval_fold_holds(e, v)) {
+        awlval* x = awlval_retain(v->folded);
+        awlval_del(v);
+        return x;
+    }
+
+    /* evaluating the call nests a level, however many of its arguments
+     * are evaluated */
+    awlval* err = awlval_eval_descend();
+    if (err) {
+        awlval_del(v);
+        return err;
+    }
+
+    /* arguments are evaluated in place, so code shared with a function
+     * body must be copied first; the original is where macros expand */
+    awlval* site = v->refs > 1 ? awlval_retain(v) : NULL;
+    v = awlval_unshare(v);
+
+    v = awlval_eval_arg(e, v, 0);
+    if (v->type == AWLVAL_ERR) {
+        if (site) {
+            awlval_del(site);
+        }
+        awlval_eval_ascend();
+        return v;
+    }
     awlval* f = awlval_pop(v, 0);
 
+    awlval* result;
     if (!ISCALLABLE(f->type)) {
-        awlval* err = awlval_err("cannot evaluate %s; incorrect type for arg 0; got %s, expected callable",
+        result = awlval_err("cannot evaluate %s; incorrect type for arg 0; got %s, expected callable",
                 awlval_type_name(AWLVAL_SEXPR), awlval_type_name(f->type));
         awlval_del(v);
-        awlval_del(f);
-        return err;
+    } else if (f->type == AWLVAL_MACRO && site) {
+        result = awlval_expand(e, f, site, v);
+    } else {
+        result = awlval_call(e, f, v);
     }
 
-    awlval* result = awlval_call(e, f, v);
+    if (site) {
+        awlval_del(site);
+    }
     awlval_del(f);
+    awlval_eval_ascend();
     return result;
 }
 
+/* Macro expansions, keyed by the address of the S-Expression that called
+ * the macro. Each entry holds its site and the macro that expanded there,
+ * so a site whose macro has been rebound expands again */
+typedef struct {
+    awlval* site;
+    awlval* macro;
+    awlval* expansion;
+} expansion_entry;
+
+static _Thread_local expansion_entry* expansions = NULL;
+static _Thread_local int expansions_size = 0;
+static _Thread_local int expansions_count = 0;
+
+static unsigned int expansion_hash(const awlval* site) {
+    uintptr_t x = (uintptr_t)site >> 3;
+    return (unsigned int)(x ^ (x >> 16));
+}
+
+static expansion_entry* expansion_slot(expansion_entry* t, int size, const awlval* site) {
+    unsigned int i = expansion_hash(site) & (size - 1);
+    while (t[i].site && t[i].site != site) {
+        i = (i + 1) & (size - 1);
+    }
+    return &t[i];
+}
+
+static void expansion_entry_del(expansion_entry* entry) {
+    awlval_del(entry->site);
+    awlval_del(entry->macro);
+    awlval_del(entry->expansion);
+}
+
+static void expansions_rebuild(int size) {
+    expansion_entry* t = safe_malloc(sizeof(expansion_entry) * size);
+    memset(t, 0, sizeof(expansion_entry) * size);
+
+    expansions_count = 0;
+    for (int i = 0; i < expansions_size; i++) {
+        if (!expansions[i].site) {
+            continue;
+        }
+        if (expansions[i].site->refs == 1) {
+            expansion_entry_del(&expansions[i]);
+        } else {
+            *expansion_slot(t, size, expansions[i].site) = expansions[i];
+            expansions_count++;
+        }
+    }
+
+    free(expansions);
+    expansions = t;
+    expansions_size = size;
+}
+
+/* Arguments are passed to a macro unevaluated, except for E-Expressions
+ * and C-Expressions, which are evaluated in the calling environment */
+static bool awlval_expands_alike(const awlval* v) {
+    switch (v->type) {
+        case AWLVAL_EEXPR:
+        case AWLVAL_CEXPR:
+            return false;
+        case AWLVAL_SEXPR:
+        case AWLVAL_QEXPR:
+            for (int i = 0; i < v->count; i++) {
+                if (!awlval_expands_alike(v->cell[i])) {
+                    return false;
+                }
+            }
+            return true;
+        default:
+            return true;
+    }
+}
+
+awlval* awlval_expand(awlenv* e, awlval* m, awlval* site, awlval* a) {
+    expansion_entry* entry = expansions ? expansion_slot(expansions, expansions_size, site) : NULL;
+    if (entry && entry->site && entry->macro == m) {
+        awlval_del(a);
+        return awlval_retain(entry->expansion);
+    }
+
+    bool expands = a->count >= m->arity - m->bound && awlval_expands_alike(a);
+    awlval* x = awlval_call(e, m, a);
+    if (!expands || x->type == AWLVAL_ERR) {
+        return x;
+    }
+
+    /* expanding may have expanded other sites, and moved this one */
+    entry = expansions ? expansion_slot(expansions, expansions_size, site) : NULL;
+    if (entry && entry->site) {
+        awlval_del(entry->macro);
+        awlval_del(entry->expansion);
+    } else {
+        if ((expansions_count + 1) * 4 > expansions_size * 3) {
+            /* drop what is no longer reachable before growing */
+            expansions_rebuild(expansions_size ? expansions_size : EXPANSIONS_INITIAL_SIZE);
+            if ((expansions_count + 1) * 2 > expansions_size) {
+                expansions_rebuild(expansions_size * 2);
+            }
+        }
+        entry = expansion_slot(expansions, expansions_size, site);
+        entry->site = awlval_retain(site);
+        expansions_count++;
+    }
+    entry->macro = awlval_retain(m);
+    entry->expansion = awlval_retain(x);
+    return x;
+}
+
+void awlval_expansions_clear(void) {
+    for (int i = 0; i < expansions_size; i++) {
+        if (expansions[i].site) {
+            expansion_entry_del(&expansions[i]);
+        }
+    }
+    free(expansions);
+    expansions = NULL;
+    expansions_size = 0;
+    expansions_count = 0;
+}
+
 awlval* awlval_call(awlenv* e, awlval* f, awlval* a) {
     /* calls a function if builtin, or evals a macro, else fills in the
      * corresponding parameters, and lets awlval_eval perform tail
@@ -139,9 +419,6 @@ awlval* awlval_call(awlenv* e, awlval* f, awlval* a) {
         return f->builtin(e, a);
     }
 
-    int given = a->count;
-    int total = f->formals->count;
-
     /* special case for macros */
     if (f->type == AWLVAL_MACRO) {
         for (int i = 0; i < a->count; i++) {
@@ -158,100 +435,147 @@ awlval* awlval_call(awlenv* e, awlval* f, awlval* a) {
         }
     }
 
-    while (a->count) {
-        if (f->formals->count == 0) {
-            awlval_del(a);
-            return awlval_err("%s passed too many arguments; got %i, expected %i",
-                    awlval_type_name(f->type), given, total);
-        }
-        awlval* sym = awlval_pop(f->formals, 0);
-
-        /* special case for variadic functions */
-        if (streq(sym->sym, "&")) {
-            if (f->formals->count != 1) {
-                awlval_del(a);
-                return awlval_err("function format invalid; symbol '&' not followed by single symbol");
-            }
-
-            awlval* nsym = awlval_pop(f->formals, 0);
-            awlval* varargs = builtin_list(e, a);
-
-            if (varargs->type == AWLVAL_ERR) {
-                awlval_del(sym);
-                awlval_del(nsym);
-                return varargs;
-            }
-
-            awlenv_put(f->env, nsym, varargs);
-            awlval_del(sym);
-            awlval_del(nsym);
-            break;
-        }
+    int remaining = f->arity - f->bound;
+    if (!f->variadic && a->count > remaining) {
+        awlval* err = awlval_err("%s passed too many arguments; got %i, expected %i",
+                awlval_type_name(f->type), a->count, remaining);
+        awlval_del(a);
+        return err;
+    }
 
-        awlval* val = awlval_eval(e, awlval_pop(a, 0));
+    /* bind into a fresh frame, in one pass; the callee itself may be
+     * shared, and keeps the arguments it was partially applied to */
+    awlenv* env = awlenv_copy(f->env);
+    int bound = f->bound;
+    while (a->count && bound < f->arity) {
+        awlval* val = a->evaluated ? awlval_pop(a, 0) : awlval_eval(e, awlval_pop(a, 0));
         if (val->type == AWLVAL_ERR) {
-            awlval_del(sym);
             awlval_del(a);
+            awlenv_del(env);
             return val;
         }
 
-        awlenv_put(f->env, sym, val);
-        awlval_del(sym);
+        awlenv_put_slot(env, bound++, val);
         awlval_del(val);
     }
 
-    /* Special case for pure variadic function with no arguments */
-    if (f->formals->count > 0 &&
-            streq(f->formals->cell[0]->sym, "&")) {
-        if (f->formals->count != 2) {
+    /* the rest of the arguments, if any, make up the variadic formal */
+    bool called = bound == f->arity;
+    if (called && f->variadic) {
+        if (f->formals->count != f->arity + 2) {
+            awlval_del(a);
+            awlenv_del(env);
             return awlval_err("function format invalid; symbol '&' not followed by single symbol");
         }
-        awlval_del(awlval_pop(f->formals, 0));
-        awlval* sym = awlval_pop(f->formals, 0);
-        awlval* val = awlval_qexpr();
 
-        awlenv_put(f->env, sym, val);
-        awlval_del(sym);
-        awlval_del(val);
-    }
+        awlval* varargs = builtin_list(e, a);
+        if (varargs->type == AWLVAL_ERR) {
+            awlenv_del(env);
+            return varargs;
+        }
 
-    if (f->formals->count == 0) {
-        f->called = true;
+        awlenv_put_slot(env, f->arity + 1, varargs);
+        awlval_del(varargs);
+    } else {
+        awlval_del(a);
     }
 
-    awlval_del(a);
+    f = awlval_applied(f, env, bound);
+    f->called = called;
 
     /* Handle macros -- they are called directly because their output must
      * be evaluated in the enclosing environment */
     if (f->type == AWLVAL_MACRO && f->called) {
-        return awlval_eval_macro(f);
+        awlval* x = awlval_eval_macro(f);
+        awlval_del(f);
+        return x;
     } else {
-        return awlval_copy(f);
+        return f;
     }
 }
 
+awlval* awlval_apply(awlenv* e, awlval* f, awlval* a) {
+    /* the call is marked evaluated, so awlval_eval binds the arguments as
+     * they are and only evaluates what the call returns */
+    a = awlval_add_front(a, f);
+    a->evaluated = true;
+
+    applying++;
+    awlval* x = awlval_eval(e, a);
+    applying--;
+    return x;
+}
+
 awlval* awlval_eval_macro(awlval* m) {
     awlenv* e = awlenv_copy(m->env);
-    awlval* b = awlval_copy(m->body);
+    awlval* b = awlval_retain(m->body);
 
     awlval* v = awlval_eval(e, b);
 
     awlenv_del(e);
 
     if (v->type == AWLVAL_QEXPR) {
+        v = awlval_unshare(v);
         v->type = AWLVAL_SEXPR;
     }
     return v;
 }
 
+/* Whether anything nested inside v is evaluated along with it; nested
+ * expressions are walked with a stack of their own, so that deeply nested
+ * data is not recursed into */
+static bool awlval_has_escapes(const awlval* v) {
+    const awlval* local[EVAL_SCAN_LOCAL_SIZE];
+    const awlval** stack = local;
+    int size = EVAL_SCAN_LOCAL_SIZE;
+    int count = 0;
+
+    bool found = false;
+    stack[count++] = v;
+    while (count > 0 && !found) {
+        const awlval* x = stack[--count];
+        for (int i = 0; i < x->count; i++) {
+            const awlval* y = x->cell[i];
+            if (y->type == AWLVAL_EEXPR || y->type == AWLVAL_CEXPR) {
+                found = true;
+                break;
+            }
+            if (!ISEXPR(y->type) || y->count == 0) {
+                continue;
+            }
+
+            if (count == size) {
+                size *= 2;
+                if (stack == local) {
+                    stack = safe_malloc(sizeof(awlval*) * size);
+                    memcpy(stack, local, sizeof(local));
+                } else {
+                    stack = safe_realloc(stack, sizeof(awlval*) * size);
+                }
+            }
+            stack[count++] = y;
+        }
+    }
+
+    if (stack != local) {
+        free(stack);
+    }
+    return found;
+}
+
 awlval* awlval_eval_inside_qexpr(awlenv* e, awlval* v) {
     switch (v->type) {
         case AWLVAL_SEXPR:
         case AWLVAL_QEXPR:
         {
+            if (!awlval_has_escapes(v)) {
+                return v;
+            }
+
             for (int i = 0; i < v->count; i++) {
                 // Special case for C-Expressions
                 if (v->cell[i]->type == AWLVAL_CEXPR) {
+                    v = awlval_unshare(v);
                     awlval* cexpr = awlval_eval_cexpr(e, awlval_pop(v, i));
                     if (cexpr->type == AWLVAL_ERR) {
                         awlval_del(v);
@@ -264,8 +588,21 @@ awlval* awlval_eval_inside_qexpr(awlenv* e, awlval* v) {
                     } else {
                         v = awlval_insert(v, cexpr, i);
                     }
-                } else {
-                    v->cell[i] = awlval_eval_inside_qexpr(e, v->cell[i]);
+                } else if (ISEXPR(v->cell[i]->type) || v->cell[i]->type == AWLVAL_EEXPR) {
+                    // Only copy the container once something inside changes
+                    awlval* x = awlval_eval_descend();
+                    if (!x) {
+                        x = awlval_eval_inside_qexpr(e, awlval_retain(v->cell[i]));
+                        awlval_eval_ascend();
+                    }
+                    if (x == v->cell[i]) {
+                        awlval_del(x);
+                        continue;
+                    }
+
+                    v = awlval_unshare(v);
+                    awlval_del(v->cell[i]);
+                    v->cell[i] = x;
                     if (v->cell[i]->type == AWLVAL_ERR) {
                         return awlval_take(v, i);
                     }
@@ -15,9 +15,52 @@
     } \
 }
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include "runtime.h"
 #include "types.h"
 
-void awlval_eval_abort(void);
+/* Evaluation nests a level for each call the tree walker makes on the C
+ * stack and for each frame the VM keeps on the heap. Going deeper than the
+ * maximum depth, or deeper than the C stack allows the tree walker, is an
+ * error rather than a crash */
+#define AWL_MAX_DEPTH 2000000
+#define AWL_STACK_SIZE (8L * 1024 * 1024)
+#define AWL_UNLIMITED_STACK_SIZE (256L * 1024 * 1024)
+
+void awlval_eval_set_max_depth(long max_depth);
+long awlval_eval_max_depth(void);
+
+/* enters one level deeper, or returns the error for going too deep */
+awlval* awlval_eval_descend(void);
+void awlval_eval_ascend(void);
+
+/* How deep the running task is, and where on its own C stack; tasks swap
+ * theirs in when they switch (see sched.h) */
+typedef struct {
+    long depth;
+    /* how many of those levels are functions applied from C, which nest
+     * on the C stack even in the VM (see awlval_apply) */
+    long applying;
+    uintptr_t stack_base;
+    size_t stack_budget;
+} eval_depth_t;
+
+eval_depth_t awlval_eval_depth_new(size_t stack_size);
+/* installs d, returning the depth it replaces */
+eval_depth_t awlval_eval_depth_swap(eval_depth_t d);
+
+/* Only flags that other tasks should run, and is safe to call from a
+ * signal handler; evaluation acts on it at its next safe point, as it does
+ * on an abort (see awl_runtime_abort) */
+void awlval_eval_preempt(void);
+/* acts on anything flagged, returning the error for an abort, or NULL */
+awlval* awlval_eval_safe_point(void);
+
+static inline bool awlval_eval_pending(void) {
+    return atomic_load_explicit(&awl_rt->eval_pending, memory_order_relaxed);
+}
 
 /* eval functions */
 awlval* awlval_eval(awlenv* e, awlval* v);
@@ -26,6 +69,15 @@ awlval* awlval_eval_args(awlenv* e, awlval* v);
 awlval* awlval_eval_sexpr(awlenv* e, awlval* v);
 awlval* awlval_call(awlenv* e, awlval* f, awlval* a);
 awlval* awlval_eval_macro(awlval* m);
+
+/* calls f with the already evaluated arguments in the S-Expression a, and
+ * evaluates the result as the call (f a...) would */
+awlval* awlval_apply(awlenv* e, awlval* f, awlval* a);
+
+/* calls the macro m from the S-Expression site, reusing the expansion made
+ * there before if it was made by m, so each call site expands once */
+awlval* awlval_expand(awlenv* e, awlval* m, awlval* site, awlval* a);
+void awlval_expansions_clear(void);
 awlval* awlval_eval_inside_qexpr(awlenv* e, awlval* v);
 awlval* awlval_eval_cexpr(awlenv* e, awlval* v);
 
@@ -0,0 +1,195 @@
+#include "fold.h"
+
+#include <stdlib.h>
+
+#include "builtins.h"
+#include "util.h"
+
+#define FOLD_SITES_INITIAL_SIZE 64
+
+static _Thread_local bool enabled = true;
+
+void fold_enable(bool e) {
+    enabled = e;
+}
+
+bool fold_enabled(void) {
+    return enabled;
+}
+
+/* Builtins that only evaluate their arguments and compute a new value
+ * from them; these are called with a NULL environment when folding */
+static const struct {
+    const char* name;
+    awlbuiltin builtin;
+} pure_builtins[] = {
+    { "+", builtin_add },
+    { "-", builtin_sub },
+    { "*", builtin_mul },
+    { "/", builtin_div },
+    { "//", builtin_trunc_div },
+    { "%", builtin_mod },
+    { "^", builtin_pow },
+    { ">", builtin_gt },
+    { ">=", builtin_gte },
+    { "<", builtin_lt },
+    { "<=", builtin_lte },
+    { "==", builtin_eq },
+    { "!=", builtin_neq },
+    { "not", builtin_not },
+    { "tail", builtin_tail },
+    { "first", builtin_first },
+    { "last", builtin_last },
+    { "list", builtin_list },
+    { "append", builtin_append },
+    { "cons", builtin_cons },
+    { "except-last", builtin_exceptlast },
+    { "dict-get", builtin_dictget },
+    { "dict-set", builtin_dictset },
+    { "dict-del", builtin_dictdel },
+    { "dict-haskey?", builtin_dicthaskey },
+    { "dict-keys", builtin_dictkeys },
+    { "dict-vals", builtin_dictvals },
+    { "len", builtin_len },
+    { "reverse", builtin_reverse },
+    { "slice", builtin_slice },
+    { "typeof", builtin_typeof },
+    { "convert", builtin_convert }
+};
+
+static awlbuiltin fold_builtin(const awlval* sym) {
+    for (size_t i = 0; i < sizeof(pure_builtins) / sizeof(pure_builtins[0]); i++) {
+        if (streq(sym->sym, pure_builtins[i].name)) {
+            return pure_builtins[i].builtin;
+        }
+    }
+    return NULL;
+}
+
+static bool fold_is_quoted(const awlval* v) {
+    for (int i = 0; i < v->count; i++) {
+        awlval_type_t t = v->cell[i]->type;
+        if (t == AWLVAL_EEXPR || t == AWLVAL_CEXPR || (ISEXPR(t) && !fold_is_quoted(v->cell[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Values that evaluate to themselves; Q-Expressions may not contain
+ * anything evaluated inside them */
+static bool fold_is_constant(const awlval* v) {
+    switch (v->type) {
+        case AWLVAL_INT:
+        case AWLVAL_FLOAT:
+        case AWLVAL_STR:
+        case AWLVAL_BOOL:
+        case AWLVAL_QSYM:
+        case AWLVAL_DICT:
+            return true;
+        case AWLVAL_QEXPR:
+            return fold_is_quoted(v);
+        default:
+            return false;
+    }
+}
+
+/* Folded calls, each held so that it can never be changed in place (see
+ * awlval_unshare) while it keeps a folded value. Calls held by nothing
+ * else are dropped when the list fills up */
+static _Thread_local awlval** sites = NULL;
+static _Thread_local int sites_size = 0;
+static _Thread_local int sites_count = 0;
+
+static void fold_hold(awlval* v) {
+    if (sites_count == sites_size) {
+        int live = 0;
+        for (int i = 0; i < sites_count; i++) {
+            if (sites[i]->refs == 1) {
+                awlval_del(sites[i]);
+            } else {
+                sites[live++] = sites[i];
+            }
+        }
+        sites_count = live;
+
+        if ((sites_count + 1) * 2 > sites_size) {
+            sites_size = sites_size ? sites_size * 2 : FOLD_SITES_INITIAL_SIZE;
+            sites = safe_realloc(sites, sizeof(awlval*) * sites_size);
+        }
+    }
+    sites[sites_count++] = awlval_retain(v);
+}
+
+static void awlval_fold_call(awlval* v) {
+    if (v->count == 0 || v->cell[0]->type != AWLVAL_SYM) {
+        return;
+    }
+    awlbuiltin builtin = fold_builtin(v->cell[0]);
+    if (!builtin) {
+        return;
+    }
+
+    awlval* args = awlval_sexpr();
+    for (int i = 1; i < v->count; i++) {
+        awlval* x = v->cell[i];
+        if (x->type == AWLVAL_SEXPR && x->folded) {
+            args = awlval_add(args, awlval_retain(x->folded));
+        } else if (fold_is_constant(x)) {
+            args = awlval_add(args, awlval_retain(x));
+        } else {
+            awlval_del(args);
+            return;
+        }
+    }
+    args->evaluated = true;
+
+    /* errors are left to be reported when the call is evaluated */
+    awlval* x = builtin(NULL, args);
+    if (!fold_is_constant(x)) {
+        awlval_del(x);
+        return;
+    }
+
+    v->folded = x;
+    fold_hold(v);
+}
+
+void awlval_fold(awlval* v) {
+    if (!ISEXPR(v->type) && v->type != AWLVAL_EEXPR && v->type != AWLVAL_CEXPR) {
+        return;
+    }
+
+    for (int i = 0; i < v->count; i++) {
+        awlval_fold(v->cell[i]);
+    }
+    if (v->type == AWLVAL_SEXPR) {
+        awlval_fold_call(v);
+    }
+}
+
+bool awlval_fold_holds(awlenv* e, const awlval* v) {
+    awlval* f = awlenv_get(e, v->cell[0]);
+    bool holds = f->type == AWLVAL_BUILTIN && f->builtin_name == v->cell[0]->sym;
+    awlval_del(f);
+
+    /* every call among the arguments was folded too */
+    for (int i = 1; holds && i < v->count; i++) {
+        if (v->cell[i]->type == AWLVAL_SEXPR) {
+            holds = awlval_fold_holds(e, v->cell[i]);
+        }
+    }
+    return holds;
+}
+
+void teardown_fold(void) {
+    for (int i = 0; i < sites_count; i++) {
+        awlval_del(sites[i]->folded);
+        sites[i]->folded = NULL;
+        awlval_del(sites[i]);
+    }
+    free(sites);
+    sites = NULL;
+    sites_size = 0;
+    sites_count = 0;
+}
@@ -0,0 +1,25 @@
+#ifndef AWL_FOLD_H
+#define AWL_FOLD_H
+
+#include <stdbool.h>
+
+#include "types.h"
+
+/* Constant folding over parsed forms: a call to a pure builtin whose
+ * arguments are literals, or calls folded in turn, is evaluated once when
+ * it is parsed and its value kept in the call's S-Expression. The call
+ * itself is left as it is, so folding is invisible to code that treats
+ * it as data, and its value is only used while every builtin symbol in it
+ * still names the builtin it did; otherwise it is evaluated as usual */
+void fold_enable(bool enabled);
+bool fold_enabled(void);
+
+/* folds the calls within v, which must not be shared yet */
+void awlval_fold(awlval* v);
+
+/* whether the folded value of v still holds in e */
+bool awlval_fold_holds(awlenv* e, const awlval* v);
+
+void teardown_fold(void);
+
+#endif
@@ -0,0 +1,429 @@
+#include "gc.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "dict.h"
+#include "hamt.h"
+#include "util.h"
+
+#define GC_TABLE_INITIAL_SIZE 256
+#define GC_STACK_INITIAL_SIZE 64
+
+/* every live environment, most recently created first */
+static _Thread_local awlenv* envs = NULL;
+static _Thread_local long live_envs = 0;
+
+static _Thread_local long min_threshold = GC_MIN_THRESHOLD;
+static _Thread_local double growth_factor = GC_GROWTH_FACTOR;
+static _Thread_local long threshold = GC_MIN_THRESHOLD;
+
+static _Thread_local bool collecting = false;
+static _Thread_local gc_stats_t stats = { 0, 0, 0, GC_MIN_THRESHOLD, 0.0, 0.0, 0.0 };
+
+void gc_track_env(awlenv* e) {
+    e->gc_prev = NULL;
+    e->gc_next = envs;
+    if (envs) {
+        envs->gc_prev = e;
+    }
+    envs = e;
+    e->gc_refs = 0;
+    e->gc_marked = false;
+    live_envs++;
+}
+
+void gc_untrack_env(awlenv* e) {
+    if (e->gc_prev) {
+        e->gc_prev->gc_next = e->gc_next;
+    } else {
+        envs = e->gc_next;
+    }
+    if (e->gc_next) {
+        e->gc_next->gc_prev = e->gc_prev;
+    }
+    live_envs--;
+}
+
+void gc_configure(long min, double growth) {
+    min_threshold = min > 0 ? min : GC_MIN_THRESHOLD;
+    growth_factor = growth > 1.0 ? growth : GC_GROWTH_FACTOR;
+    threshold = min_threshold;
+}
+
+void gc_maybe_collect(void) {
+    if (live_envs >= threshold && !collecting) {
+        gc_collect();
+    }
+}
+
+/* Values never reference environments directly except through functions,
+ * so only these are traced; everything else is a leaf */
+static bool gc_is_container(const awlval* v) {
+    switch (v->type) {
+        case AWLVAL_FN:
+        case AWLVAL_MACRO:
+        case AWLVAL_DICT:
+            return true;
+        case AWLVAL_SEXPR:
+        case AWLVAL_QEXPR:
+        case AWLVAL_EEXPR:
+        case AWLVAL_CEXPR:
+            return v->count > 0 || v->backing;
+        default:
+            return false;
+    }
+}
+
+/* Container values, dict map nodes and environment bindings seen during a
+ * collection, keyed by address; the low bits tag nodes and bindings to
+ * tell them apart from values */
+#define GC_NODE_TAG ((uintptr_t)1)
+#define GC_BINDINGS_TAG ((uintptr_t)2)
+#define GC_TAG_MASK (GC_NODE_TAG | GC_BINDINGS_TAG)
+
+typedef struct {
+    void* p;
+    int gc_refs;
+    bool marked;
+} gc_entry;
+
+static _Thread_local gc_entry* table = NULL;
+static _Thread_local int table_size = 0;
+static _Thread_local int table_count = 0;
+
+static _Thread_local void** stack = NULL;
+static _Thread_local int stack_size = 0;
+static _Thread_local int stack_count = 0;
+
+static void* gc_tag_node(hamt_node* n) {
+    return (void*)((uintptr_t)n | GC_NODE_TAG);
+}
+
+static void* gc_tag_bindings(dict* d) {
+    return (void*)((uintptr_t)d | GC_BINDINGS_TAG);
+}
+
+static uintptr_t gc_tag(const void* p) {
+    return (uintptr_t)p & GC_TAG_MASK;
+}
+
+static void* gc_untag(void* p) {
+    return (void*)((uintptr_t)p & ~GC_TAG_MASK);
+}
+
+static unsigned int gc_hash(const void* p) {
+    uintptr_t x = (uintptr_t)p >> 3;
+    return (unsigned int)(x ^ (x >> 16));
+}
+
+static gc_entry* gc_slot(gc_entry* t, int size, const void* p) {
+    unsigned int i = gc_hash(p) & (size - 1);
+    while (t[i].p && t[i].p != p) {
+        i = (i + 1) & (size - 1);
+    }
+    return &t[i];
+}
+
+static void gc_table_grow(void) {
+    int size = table_size ? table_size * 2 : GC_TABLE_INITIAL_SIZE;
+    gc_entry* t = safe_malloc(sizeof(gc_entry) * size);
+    memset(t, 0, sizeof(gc_entry) * size);
+
+    for (int i = 0; i < table_size; i++) {
+        if (table[i].p) {
+            *gc_slot(t, size, table[i].p) = table[i];
+        }
+    }
+
+    free(table);
+    table = t;
+    table_size = size;
+}
+
+static gc_entry* gc_lookup(void* p, int refs, bool* inserted) {
+    gc_entry* entry = table ? gc_slot(table, table_size, p) : NULL;
+    *inserted = entry == NULL || entry->p == NULL;
+    if (*inserted) {
+        if ((table_count + 1) * 4 > table_size * 3) {
+            gc_table_grow();
+            entry = gc_slot(table, table_size, p);
+        }
+        entry->p = p;
+        entry->gc_refs = refs;
+        entry->marked = false;
+        table_count++;
+    }
+    return entry;
+}
+
+static void gc_push(void* p) {
+    if (stack_count == stack_size) {
+        stack_size = stack_size ? stack_size * 2 : GC_STACK_INITIAL_SIZE;
+        stack = safe_realloc(stack, sizeof(void*) * stack_size);
+    }
+    stack[stack_count++] = p;
+}
+
+typedef struct {
+    void(*val)(awlval*);
+    void(*node)(hamt_node*);
+    void(*env)(awlenv*);
+} gc_visitor;
+
+static void gc_visit_children(void* p, const gc_visitor* visit) {
+    if (gc_tag(p) == GC_BINDINGS_TAG) {
+        dict* d = gc_untag(p);
+        for (int i = 0; i < d->size; i++) {
+            if (d->syms[i]) {
+                visit->val(d->vals[i]);
+            }
+        }
+        return;
+    }
+
+    if (gc_tag(p) == GC_NODE_TAG) {
+        hamt_node* n = gc_untag(p);
+        for (int i = 0; i < n->count; i++) {
+            if (n->entries[i].key) {
+                visit->val(n->entries[i].val);
+            } else {
+                visit->node(n->entries[i].child);
+            }
+        }
+        return;
+    }
+
+    awlval* v = p;
+    switch (v->type) {
+        case AWLVAL_FN:
+        case AWLVAL_MACRO:
+            visit->env(v->env);
+            visit->val(v->formals);
+            visit->val(v->body);
+            break;
+        case AWLVAL_DICT:
+            if (v->map) {
+                visit->node(v->map);
+            }
+            break;
+        default:
+            /* a view holds its backing, not the cells it borrows */
+            if (v->backing) {
+                visit->val(v->backing);
+                break;
+            }
+            for (int i = 0; i < v->count; i++) {
+                visit->val(v->cell[i]);
+            }
+            break;
+    }
+}
+
+/* Pass 1: subtract every internal reference from its target */
+static void gc_unref_env(awlenv* e) {
+    e->gc_refs--;
+}
+
+static void gc_unref(void* p, int refs) {
+    bool inserted;
+    gc_entry* entry = gc_lookup(p, refs, &inserted);
+    entry->gc_refs--;
+    if (inserted) {
+        gc_push(p);
+    }
+}
+
+static void gc_unref_val(awlval* v) {
+    if (gc_is_container(v)) {
+        gc_unref(v, v->refs);
+    }
+}
+
+static void gc_unref_node(hamt_node* n) {
+    gc_unref(gc_tag_node(n), n->refs);
+}
+
+static const gc_visitor gc_unref_visitor = { gc_unref_val, gc_unref_node, gc_unref_env };
+
+static void gc_subtract(void) {
+    for (awlenv* e = envs; e; e = e->gc_next) {
+        e->gc_refs = e->references;
+        e->gc_marked = false;
+    }
+
+    for (awlenv* e = envs; e; e = e->gc_next) {
+        if (e->parent) {
+            gc_unref_env(e->parent);
+        }
+        if (e->slot_names) {
+            gc_unref_val(e->slot_names);
+            for (int i = 0; i < e->slot_names->count; i++) {
+                if (e->slots[i]) {
+                    gc_unref_val(e->slots[i]);
+                }
+            }
+        }
+        /* frames may share their bindings (see awlenv_copy), which hold a
+         * single reference to each value however many frames hold them */
+        if (e->internal_dict) {
+            gc_unref(gc_tag_bindings(e->internal_dict), 0);
+        }
+
+        while (stack_count > 0) {
+            gc_visit_children(stack[--stack_count], &gc_unref_visitor);
+        }
+    }
+}
+
+/* Pass 2: anything still referenced from outside is a root */
+static _Thread_local awlenv** env_stack = NULL;
+static _Thread_local int env_stack_size = 0;
+static _Thread_local int env_stack_count = 0;
+
+static void gc_mark_env(awlenv* e) {
+    if (e->gc_marked) {
+        return;
+    }
+    e->gc_marked = true;
+
+    if (env_stack_count == env_stack_size) {
+        env_stack_size = env_stack_size ? env_stack_size * 2 : GC_STACK_INITIAL_SIZE;
+        env_stack = safe_realloc(env_stack, sizeof(awlenv*) * env_stack_size);
+    }
+    env_stack[env_stack_count++] = e;
+}
+
+static void gc_mark(void* p, int refs) {
+    bool inserted;
+    gc_entry* entry = gc_lookup(p, refs, &inserted);
+    if (!entry->marked) {
+        entry->marked = true;
+        gc_push(p);
+    }
+}
+
+static void gc_mark_val(awlval* v) {
+    if (gc_is_container(v)) {
+        gc_mark(v, v->refs);
+    }
+}
+
+static void gc_mark_node(hamt_node* n) {
+    gc_mark(gc_tag_node(n), n->refs);
+}
+
+static const gc_visitor gc_mark_visitor = { gc_mark_val, gc_mark_node, gc_mark_env };
+
+static void gc_mark_roots(void) {
+    for (awlenv* e = envs; e; e = e->gc_next) {
+        if (e->gc_refs > 0) {
+            gc_mark_env(e);
+        }
+    }
+
+    for (int i = 0; i < table_size; i++) {
+        if (table[i].p && table[i].gc_refs > 0 && !table[i].marked) {
+            table[i].marked = true;
+            gc_push(table[i].p);
+        }
+    }
+
+    while (stack_count > 0 || env_stack_count > 0) {
+        if (stack_count > 0) {
+            gc_visit_children(stack[--stack_count], &gc_mark_visitor);
+        } else {
+            awlenv* e = env_stack[--env_stack_count];
+            if (e->parent) {
+                gc_mark_env(e->parent);
+            }
+            if (e->slot_names) {
+                gc_mark_val(e->slot_names);
+                for (int i = 0; i < e->slot_names->count; i++) {
+                    if (e->slots[i]) {
+                        gc_mark_val(e->slots[i]);
+                    }
+                }
+            }
+            if (e->internal_dict) {
+                gc_mark(gc_tag_bindings(e->internal_dict), 0);
+            }
+        }
+    }
+}
+
+/* Pass 3: break the cycles of unmarked environments and let reference
+ * counting free the rest */
+static long gc_sweep(void) {
+    env_stack_count = 0;
+    for (awlenv* e = envs; e; e = e->gc_next) {
+        if (!e->gc_marked) {
+            /* hold the environment so that it outlives its own cycle */
+            e->references++;
+            gc_mark_env(e);
+        }
+    }
+
+    for (int i = 0; i < env_stack_count; i++) {
+        awlenv_clear(env_stack[i]);
+    }
+
+    long freed = 0;
+    for (int i = 0; i < env_stack_count; i++) {
+        if (env_stack[i]->references == 1) {
+            freed++;
+        }
+        awlenv_del(env_stack[i]);
+    }
+    env_stack_count = 0;
+    return freed;
+}
+
+long gc_collect(void) {
+    if (collecting) {
+        return 0;
+    }
+    collecting = true;
+    clock_t start = clock();
+
+    gc_subtract();
+    gc_mark_roots();
+    long freed = gc_sweep();
+
+    free(table);
+    table = NULL;
+    table_size = 0;
+    table_count = 0;
+
+    long next = (long)(live_envs * growth_factor);
+    threshold = next > min_threshold ? next : min_threshold;
+
+    double pause = (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+    stats.collections++;
+    stats.freed += freed;
+    stats.last_pause = pause;
+    stats.total_pause += pause;
+    if (pause > stats.max_pause) {
+        stats.max_pause = pause;
+    }
+
+    collecting = false;
+    return freed;
+}
+
+gc_stats_t gc_get_stats(void) {
+    stats.live = live_envs;
+    stats.threshold = threshold;
+    return stats;
+}
+
+void teardown_gc(void) {
+    free(stack);
+    stack = NULL;
+    stack_size = 0;
+    free(env_stack);
+    env_stack = NULL;
+    env_stack_size = 0;
+}
@@ -0,0 +1,40 @@
+#ifndef AWL_GC_H
+#define AWL_GC_H
+
+#include <stdbool.h>
+
+#include "types.h"
+
+/* Environments are reference counted, but closures stored in the
+ * environment they capture form cycles that counting alone never frees.
+ * The collector finds its roots by subtracting references internal to the
+ * env/value graph from each object's count: whatever is still referenced
+ * afterwards is held by the top-level owner or a live evaluator frame */
+#define GC_MIN_THRESHOLD 1024
+#define GC_GROWTH_FACTOR 2.0
+
+typedef struct {
+    long collections;
+    long freed;
+    long live;
+    long threshold;
+    double last_pause;
+    double max_pause;
+    double total_pause;
+} gc_stats_t;
+
+void gc_track_env(awlenv* e);
+void gc_untrack_env(awlenv* e);
+
+/* collect once the number of live environments exceeds the threshold; the
+ * threshold is then reset to max(min_threshold, live * growth_factor) */
+void gc_configure(long min_threshold, double growth_factor);
+void gc_maybe_collect(void);
+long gc_collect(void);
+
+gc_stats_t gc_get_stats(void);
+
+/* frees what collections keep around for the next one */
+void teardown_gc(void);
+
+#endif
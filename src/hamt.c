@@ -0,0 +1,271 @@
+#include "hamt.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "intern.h"
+#include "pool.h"
+
+#define HAMT_MASK ((1u << HAMT_BITS) - 1)
+
+static int hamt_popcount(unsigned int x) {
+    x = x - ((x >> 1) & 0x55555555u);
+    x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+    x = (x + (x >> 4)) & 0x0F0F0F0Fu;
+    return (int)((x * 0x01010101u) >> 24);
+}
+
+static size_t hamt_node_size(int count) {
+    return sizeof(hamt_node) + sizeof(hamt_entry) * count;
+}
+
+static hamt_node* hamt_node_new(unsigned int bitmap, int count) {
+    hamt_node* n = pool_alloc(hamt_node_size(count));
+    n->refs = 1;
+    n->bitmap = bitmap;
+    n->count = count;
+    return n;
+}
+
+static void hamt_entry_retain(const hamt_entry* e) {
+    if (e->key) {
+        intern_retain(e->key);
+        awlval_retain(e->val);
+    } else {
+        hamt_retain(e->child);
+    }
+}
+
+static void hamt_entry_del(const hamt_entry* e) {
+    if (e->key) {
+        intern_release(e->key);
+        awlval_del(e->val);
+    } else {
+        hamt_del(e->child);
+    }
+}
+
+hamt_node* hamt_retain(hamt_node* n) {
+    if (n) {
+        n->refs++;
+    }
+    return n;
+}
+
+void hamt_del(hamt_node* n) {
+    if (n == NULL || --n->refs > 0) {
+        return;
+    }
+    for (int i = 0; i < n->count; i++) {
+        hamt_entry_del(&n->entries[i]);
+    }
+    pool_free(n, hamt_node_size(n->count));
+}
+
+/* A copy of n sharing all of its entries */
+static hamt_node* hamt_node_clone(const hamt_node* n) {
+    hamt_node* x = hamt_node_new(n->bitmap, n->count);
+    for (int i = 0; i < n->count; i++) {
+        x->entries[i] = n->entries[i];
+        hamt_entry_retain(&x->entries[i]);
+    }
+    return x;
+}
+
+/* A copy of n with e inserted at position i; e's reference is taken over */
+static hamt_node* hamt_node_insert(const hamt_node* n, unsigned int bitmap, int i, hamt_entry e) {
+    int count = n ? n->count : 0;
+    hamt_node* x = hamt_node_new(bitmap, count + 1);
+    for (int j = 0; j < count; j++) {
+        x->entries[j < i ? j : j + 1] = n->entries[j];
+        hamt_entry_retain(&n->entries[j]);
+    }
+    x->entries[i] = e;
+    return x;
+}
+
+/* A copy of n without the entry at position i */
+static hamt_node* hamt_node_remove(const hamt_node* n, unsigned int bitmap, int i) {
+    if (n->count == 1) {
+        return NULL;
+    }
+    hamt_node* x = hamt_node_new(bitmap, n->count - 1);
+    for (int j = 0; j < n->count; j++) {
+        if (j != i) {
+            x->entries[j < i ? j : j - 1] = n->entries[j];
+            hamt_entry_retain(&n->entries[j]);
+        }
+    }
+    return x;
+}
+
+/* A copy of n with the entry at position i replaced; e's reference is
+ * taken over */
+static hamt_node* hamt_node_replace(const hamt_node* n, int i, hamt_entry e) {
+    hamt_node* x = hamt_node_clone(n);
+    hamt_entry_del(&x->entries[i]);
+    x->entries[i] = e;
+    return x;
+}
+
+static hamt_entry hamt_leaf(char* k, awlval* v) {
+    hamt_entry e;
+    e.key = intern_retain(k);
+    e.val = awlval_retain(v);
+    return e;
+}
+
+static hamt_entry hamt_branch(hamt_node* child) {
+    hamt_entry e;
+    e.key = NULL;
+    e.child = child;
+    return e;
+}
+
+/* Below the last level of hash bits, nodes hold colliding keys in a list */
+static bool hamt_is_collision(int shift) {
+    return shift >= HAMT_HASH_BITS;
+}
+
+static int hamt_collision_find(const hamt_node* n, const char* k) {
+    for (int i = 0; i < n->count; i++) {
+        if (n->entries[i].key == k) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+awlval* hamt_get(const hamt_node* n, const char* k) {
+    unsigned int hash = intern_hash(k);
+    for (int shift = 0; n; shift += HAMT_BITS) {
+        if (hamt_is_collision(shift)) {
+            int i = hamt_collision_find(n, k);
+            return i == -1 ? NULL : n->entries[i].val;
+        }
+
+        unsigned int bit = 1u << ((hash >> shift) & HAMT_MASK);
+        if (!(n->bitmap & bit)) {
+            return NULL;
+        }
+
+        const hamt_entry* e = &n->entries[hamt_popcount(n->bitmap & (bit - 1))];
+        if (e->key) {
+            return e->key == k ? e->val : NULL;
+        }
+        n = e->child;
+    }
+    return NULL;
+}
+
+static hamt_node* hamt_put_at(const hamt_node* n, int shift, unsigned int hash,
+        char* k, awlval* v, bool* added) {
+    if (hamt_is_collision(shift)) {
+        int i = n ? hamt_collision_find(n, k) : -1;
+        *added = i == -1;
+        if (i == -1) {
+            return hamt_node_insert(n, 0, n ? n->count : 0, hamt_leaf(k, v));
+        }
+        return hamt_node_replace(n, i, hamt_leaf(k, v));
+    }
+
+    unsigned int bitmap = n ? n->bitmap : 0;
+    unsigned int bit = 1u << ((hash >> shift) & HAMT_MASK);
+    int i = hamt_popcount(bitmap & (bit - 1));
+
+    if (!(bitmap & bit)) {
+        *added = true;
+        return hamt_node_insert(n, bitmap | bit, i, hamt_leaf(k, v));
+    }
+
+    const hamt_entry* e = &n->entries[i];
+    if (e->key == NULL) {
+        hamt_node* child = hamt_put_at(e->child, shift + HAMT_BITS, hash, k, v, added);
+        return hamt_node_replace(n, i, hamt_branch(child));
+    }
+
+    if (e->key == k) {
+        *added = false;
+        return hamt_node_replace(n, i, hamt_leaf(k, v));
+    }
+
+    /* two keys share this slot: push both one level down */
+    bool ignored;
+    hamt_node* single = hamt_put_at(NULL, shift + HAMT_BITS, intern_hash(e->key),
+            e->key, e->val, &ignored);
+    hamt_node* child = hamt_put_at(single, shift + HAMT_BITS, hash, k, v, added);
+    hamt_del(single);
+    return hamt_node_replace(n, i, hamt_branch(child));
+}
+
+hamt_node* hamt_put(const hamt_node* n, char* k, awlval* v, bool* added) {
+    return hamt_put_at(n, 0, intern_hash(k), k, v, added);
+}
+
+static hamt_node* hamt_rm_at(const hamt_node* n, int shift, unsigned int hash,
+        const char* k, bool* removed) {
+    *removed = false;
+
+    if (hamt_is_collision(shift)) {
+        int i = hamt_collision_find(n, k);
+        if (i == -1) {
+            return hamt_retain((hamt_node*)n);
+        }
+        *removed = true;
+        return hamt_node_remove(n, 0, i);
+    }
+
+    unsigned int bit = 1u << ((hash >> shift) & HAMT_MASK);
+    if (!(n->bitmap & bit)) {
+        return hamt_retain((hamt_node*)n);
+    }
+
+    int i = hamt_popcount(n->bitmap & (bit - 1));
+    const hamt_entry* e = &n->entries[i];
+    if (e->key) {
+        if (e->key != k) {
+            return hamt_retain((hamt_node*)n);
+        }
+        *removed = true;
+        return hamt_node_remove(n, n->bitmap & ~bit, i);
+    }
+
+    hamt_node* child = hamt_rm_at(e->child, shift + HAMT_BITS, hash, k, removed);
+    if (!*removed) {
+        hamt_del(child);
+        return hamt_retain((hamt_node*)n);
+    }
+    if (child == NULL) {
+        return hamt_node_remove(n, n->bitmap & ~bit, i);
+    }
+
+    /* a child left holding a single key is folded back into this node */
+    if (child->count == 1 && child->entries[0].key) {
+        hamt_node* x = hamt_node_replace(n, i, hamt_leaf(child->entries[0].key, child->entries[0].val));
+        hamt_del(child);
+        return x;
+    }
+    return hamt_node_replace(n, i, hamt_branch(child));
+}
+
+hamt_node* hamt_rm(const hamt_node* n, const char* k, bool* removed) {
+    if (n == NULL) {
+        *removed = false;
+        return NULL;
+    }
+    return hamt_rm_at(n, 0, intern_hash(k), k, removed);
+}
+
+void hamt_foreach(const hamt_node* n, hamt_visitor visit, void* data) {
+    if (n == NULL) {
+        return;
+    }
+    for (int i = 0; i < n->count; i++) {
+        const hamt_entry* e = &n->entries[i];
+        if (e->key) {
+            visit(e->key, e->val, data);
+        } else {
+            hamt_foreach(e->child, visit, data);
+        }
+    }
+}
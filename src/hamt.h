@@ -0,0 +1,42 @@
+#ifndef AWL_HAMT_H
+#define AWL_HAMT_H
+
+#include <stdbool.h>
+
+#include "types.h"
+
+/* Persistent hash array mapped trie from interned names to values. An
+ * update copies only the nodes on the path to the changed entry and shares
+ * the rest with the original, so nodes are reference counted and never
+ * modified once built. The empty map is NULL */
+#define HAMT_BITS 5
+#define HAMT_HASH_BITS 32
+
+typedef struct {
+    /* NULL for an entry pointing at a child node */
+    char* key;
+    union {
+        awlval* val;
+        hamt_node* child;
+    };
+} hamt_entry;
+
+struct hamt_node {
+    int refs;
+    unsigned int bitmap;
+    int count;
+    hamt_entry entries[];
+};
+
+hamt_node* hamt_retain(hamt_node* n);
+void hamt_del(hamt_node* n);
+
+/* lookups borrow the value; updates return a new map and leave n intact */
+awlval* hamt_get(const hamt_node* n, const char* k);
+hamt_node* hamt_put(const hamt_node* n, char* k, awlval* v, bool* added);
+hamt_node* hamt_rm(const hamt_node* n, const char* k, bool* removed);
+
+typedef void(*hamt_visitor)(char* k, awlval* v, void* data);
+void hamt_foreach(const hamt_node* n, hamt_visitor visit, void* data);
+
+#endif
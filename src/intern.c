@@ -0,0 +1,133 @@
+#include "intern.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "util.h"
+
+#define INTERN_INITIAL_SIZE 256
+#define INTERN_GROWTH_FACTOR 2
+
+typedef struct intern_entry {
+    struct intern_entry* next;
+    int refs;
+    unsigned int hash;
+    int length;
+    char name[];
+} intern_entry;
+
+static _Thread_local intern_entry** buckets = NULL;
+static _Thread_local int size = 0;
+static _Thread_local int count = 0;
+
+static unsigned int intern_compute_hash(const char* str) {
+    /* djb2 hash */
+    unsigned int hash = 5381;
+    for (int i = 0; str[i]; i++) {
+        /* XOR hash * 33 with current char val */
+        hash = ((hash << 5) + hash) ^ str[i];
+    }
+    return hash;
+}
+
+static intern_entry* intern_entry_of(const char* s) {
+    return (intern_entry*)(s - offsetof(intern_entry, name));
+}
+
+static void intern_resize(void) {
+    int newsize = size ? size * INTERN_GROWTH_FACTOR : INTERN_INITIAL_SIZE;
+    intern_entry** newbuckets = safe_malloc(sizeof(intern_entry*) * newsize);
+    for (int i = 0; i < newsize; i++) {
+        newbuckets[i] = NULL;
+    }
+
+    for (int i = 0; i < size; i++) {
+        intern_entry* entry = buckets[i];
+        while (entry) {
+            intern_entry* next = entry->next;
+            int j = entry->hash % newsize;
+            entry->next = newbuckets[j];
+            newbuckets[j] = entry;
+            entry = next;
+        }
+    }
+
+    free(buckets);
+    buckets = newbuckets;
+    size = newsize;
+}
+
+char* intern(const char* s) {
+    if (count >= size) {
+        intern_resize();
+    }
+
+    unsigned int hash = intern_compute_hash(s);
+    intern_entry** bucket = &buckets[hash % size];
+    for (intern_entry* entry = *bucket; entry; entry = entry->next) {
+        if (entry->hash == hash && streq(entry->name, s)) {
+            entry->refs++;
+            return entry->name;
+        }
+    }
+
+    int length = strlen(s);
+    intern_entry* entry = safe_malloc(sizeof(intern_entry) + length + 1);
+    entry->refs = 1;
+    entry->hash = hash;
+    entry->length = length;
+    memcpy(entry->name, s, length + 1);
+    entry->next = *bucket;
+    *bucket = entry;
+    count++;
+
+    return entry->name;
+}
+
+char* intern_retain(const char* s) {
+    intern_entry_of(s)->refs++;
+    return (char*)s;
+}
+
+void intern_release(const char* s) {
+    intern_entry* entry = intern_entry_of(s);
+    if (--entry->refs > 0) {
+        return;
+    }
+
+    intern_entry** link = &buckets[entry->hash % size];
+    while (*link != entry) {
+        link = &(*link)->next;
+    }
+    *link = entry->next;
+    count--;
+    free(entry);
+}
+
+unsigned int intern_hash(const char* s) {
+    return intern_entry_of(s)->hash;
+}
+
+int intern_length(const char* s) {
+    return intern_entry_of(s)->length;
+}
+
+int intern_count(void) {
+    return count;
+}
+
+void teardown_intern(void) {
+    for (int i = 0; i < size; i++) {
+        intern_entry* entry = buckets[i];
+        while (entry) {
+            intern_entry* next = entry->next;
+            free(entry);
+            entry = next;
+        }
+    }
+    free(buckets);
+    buckets = NULL;
+    size = 0;
+    count = 0;
+}
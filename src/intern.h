@@ -0,0 +1,19 @@
+#ifndef AWL_INTERN_H
+#define AWL_INTERN_H
+
+/* Symbol names are interned: every distinct name is stored exactly once,
+ * alongside its hash and length, so interned names can be compared by
+ * pointer and hashed without touching their characters. Names are counted:
+ * intern and intern_retain each take a reference, which intern_release
+ * gives back, and a name is freed with its last reference */
+char* intern(const char* s);
+char* intern_retain(const char* s);
+void intern_release(const char* s);
+unsigned int intern_hash(const char* s);
+int intern_length(const char* s);
+/* how many distinct names are held */
+int intern_count(void);
+
+void teardown_intern(void);
+
+#endif
@@ -1,5 +1,12 @@
+#include <stdlib.h>
+#include <string.h>
+
 #include "awl.h"
+#include "eval.h"
+#include "fold.h"
+#include "par.h"
 #include "repl.h"
+#include "vm.h"
 
 #ifndef EMSCRIPTEN
 
@@ -7,6 +14,23 @@ int main(int argc, char** argv) {
     setup_awl();
     awlenv* e = awlenv_new_top_level();
 
+    /* strip interpreter options, leaving the scripts to run */
+    int scripts = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--vm") == 0) {
+            vm_enable(true);
+        } else if (strcmp(argv[i], "--no-fold") == 0) {
+            fold_enable(false);
+        } else if (strcmp(argv[i], "--max-depth") == 0 && i + 1 < argc) {
+            awlval_eval_set_max_depth(strtol(argv[++i], NULL, 10));
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            par_set_workers(strtol(argv[++i], NULL, 10));
+        } else {
+            argv[scripts++] = argv[i];
+        }
+    }
+    argc = scripts;
+
     /* if the only argument is the interpreter name, run repl */
     if (argc == 1) {
         run_repl(e);
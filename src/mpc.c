@@ -122,7 +122,9 @@ void mpc_err_string_cat(char *buffer, int *pos, int *max, char *fmt, ...) {
   va_end(va);
 }
 
-static char char_unescape_buffer[3];
+/* per thread, as each interpreter thread may report parse errors at once;
+ * the last byte stays NUL */
+static _Thread_local char char_unescape_buffer[4];
 
 static char *mpc_err_char_unescape(char c) {
   
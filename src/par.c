@@ -0,0 +1,844 @@
+/* pthread stack sizes, timed waits and counting processors are POSIX
+ * rather than C11 */
+#define _GNU_SOURCE
+
+#include "par.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "awl.h"
+#include "eval.h"
+#include "dict.h"
+#include "gc.h"
+#include "hamt.h"
+#include "pool.h"
+#include "util.h"
+#include "vm.h"
+
+#define PAR_MAP_INITIAL_SIZE 64
+/* how often a caller waiting on its chunks checks to be aborted */
+#define PAR_POLL_NSEC (10L * 1000000)
+
+/* Pointers to pointers, for the environments a copy has made so far */
+typedef struct {
+    const void** keys;
+    void** vals;
+    int size;
+    int count;
+} par_map;
+
+static unsigned int par_hash(const void* p) {
+    uintptr_t x = (uintptr_t)p >> 3;
+    return (unsigned int)(x ^ (x >> 16));
+}
+
+static int par_map_slot(const void** keys, int size, const void* k) {
+    int i = par_hash(k) & (size - 1);
+    while (keys[i] && keys[i] != k) {
+        i = (i + 1) & (size - 1);
+    }
+    return i;
+}
+
+static void* par_map_get(const par_map* m, const void* k) {
+    if (!m->size) {
+        return NULL;
+    }
+    int i = par_map_slot(m->keys, m->size, k);
+    return m->keys[i] ? m->vals[i] : NULL;
+}
+
+static void par_map_put(par_map* m, const void* k, void* v) {
+    if ((m->count + 1) * 4 > m->size * 3) {
+        int size = m->size ? m->size * 2 : PAR_MAP_INITIAL_SIZE;
+        const void** keys = safe_malloc(sizeof(void*) * size);
+        void** vals = safe_malloc(sizeof(void*) * size);
+        memset(keys, 0, sizeof(void*) * size);
+
+        for (int i = 0; i < m->size; i++) {
+            if (m->keys[i]) {
+                int j = par_map_slot(keys, size, m->keys[i]);
+                keys[j] = m->keys[i];
+                vals[j] = m->vals[i];
+            }
+        }
+
+        free(m->keys);
+        free(m->vals);
+        m->keys = keys;
+        m->vals = vals;
+        m->size = size;
+    }
+
+    int i = par_map_slot(m->keys, m->size, k);
+    m->keys[i] = k;
+    m->vals[i] = v;
+    m->count++;
+}
+
+static void par_map_clear(par_map* m) {
+    free(m->keys);
+    free(m->vals);
+    m->keys = NULL;
+    m->vals = NULL;
+    m->size = 0;
+    m->count = 0;
+}
+
+/* What the function of a parallel call can reach: the names that occur
+ * in it, in its list and in its initial value, and in whatever those
+ * names are bound to in the frames it can see, closed over. Walked the
+ * same way whether the call runs on the pool or not, so a channel or a
+ * generator it could reach fails the call either way */
+typedef struct {
+    /* interned names, each to itself */
+    par_map names;
+    /* the values and frames walked so far */
+    par_map seen;
+    awlenv** envs;
+    int env_count;
+    int env_size;
+    /* set to walk what a chunk evaluated to instead: the frames made since
+     * the freeze are followed whole, and the older ones not at all */
+    bool fresh;
+    awlval* err;
+} par_scope;
+
+static void par_scope_value(par_scope* s, const awlval* v);
+
+static bool par_named(const par_map* names, const char* name) {
+    return par_map_get(names, name) != NULL;
+}
+
+static void par_scope_binding(par_scope* s, const char* name, const awlval* v) {
+    if (v && (s->fresh || par_named(&s->names, name))) {
+        par_scope_value(s, v);
+    }
+}
+
+static void par_scope_env(par_scope* s, awlenv* e) {
+    for (; e && !par_map_get(&s->seen, e); e = e->parent) {
+        if (s->fresh && awlenv_frozen(e, false)) {
+            return;
+        }
+        par_map_put(&s->seen, e, e);
+        if (s->env_count == s->env_size) {
+            s->env_size = s->env_size ? s->env_size * 2 : PAR_MAP_INITIAL_SIZE;
+            s->envs = safe_realloc(s->envs, sizeof(awlenv*) * s->env_size);
+        }
+        s->envs[s->env_count++] = e;
+
+        /* names found while this walks look in e themselves */
+        if (e->slot_names) {
+            for (int i = 0; i < e->slot_names->count; i++) {
+                par_scope_binding(s, e->slot_names->cell[i]->sym, e->slots[i]);
+            }
+        }
+        if (e->internal_dict) {
+            dict* d = e->internal_dict;
+            for (int i = 0; i < d->size; i++) {
+                if (d->syms[i]) {
+                    par_scope_binding(s, d->syms[i], d->vals[i]);
+                }
+            }
+        }
+    }
+}
+
+static awlval* par_binding(const awlenv* e, const char* name) {
+    if (e->slot_names) {
+        for (int i = 0; i < e->slot_names->count; i++) {
+            if (e->slot_names->cell[i]->sym == name) {
+                return e->slots[i];
+            }
+        }
+    }
+    int i = e->internal_dict ? dict_index(e->internal_dict, name) : -1;
+    return i != -1 ? e->internal_dict->vals[i] : NULL;
+}
+
+static void par_scope_name(par_scope* s, char* name) {
+    if (s->fresh || par_named(&s->names, name)) {
+        return;
+    }
+    par_map_put(&s->names, name, name);
+    for (int i = 0; i < s->env_count; i++) {
+        awlval* v = par_binding(s->envs[i], name);
+        if (v) {
+            par_scope_value(s, v);
+        }
+    }
+}
+
+static void par_scope_entry(char* k, awlval* v, void* data) {
+    (void)k;
+    par_scope_value(data, v);
+}
+
+static void par_scope_value(par_scope* s, const awlval* v) {
+    switch (v->type) {
+        case AWLVAL_SYM:
+        case AWLVAL_QSYM:
+            par_scope_name(s, v->sym);
+            return;
+
+        case AWLVAL_CHAN:
+        case AWLVAL_GEN:
+            /* these belong to the tasks of the one interpreter */
+            if (!s->err) {
+                s->err = awlval_err("%s cannot be used in a parallel call",
+                        awlval_type_name(v->type));
+            }
+            return;
+
+        case AWLVAL_FN:
+        case AWLVAL_MACRO:
+        case AWLVAL_DICT:
+        case AWLVAL_SEXPR:
+        case AWLVAL_QEXPR:
+        case AWLVAL_EEXPR:
+        case AWLVAL_CEXPR:
+            break;
+
+        default:
+            return;
+    }
+
+    if (par_map_get(&s->seen, v)) {
+        return;
+    }
+    par_map_put(&s->seen, v, (void*)v);
+
+    if (v->type == AWLVAL_FN || v->type == AWLVAL_MACRO) {
+        par_scope_value(s, v->formals);
+        par_scope_value(s, v->body);
+        par_scope_env(s, v->env);
+    } else if (v->type == AWLVAL_DICT) {
+        if (v->map) {
+            hamt_foreach(v->map, par_scope_entry, s);
+        }
+    } else {
+        for (int i = 0; i < v->count; i++) {
+            par_scope_value(s, v->cell[i]);
+        }
+    }
+}
+
+static void par_scope_clear(par_scope* s) {
+    par_map_clear(&s->names);
+    par_map_clear(&s->seen);
+    free(s->envs);
+    if (s->err) {
+        awlval_del(s->err);
+    }
+    memset(s, 0, sizeof(par_scope));
+}
+
+/* r, or the error of a channel or generator it leads to */
+static awlval* par_checked(awlval* r) {
+    par_scope s;
+    memset(&s, 0, sizeof(par_scope));
+    s.fresh = true;
+    par_scope_value(&s, r);
+    if (s.err) {
+        awlval_del(r);
+        r = s.err;
+        s.err = NULL;
+    }
+    par_scope_clear(&s);
+    return r;
+}
+
+/* Deep copies into the calling thread's interpreter, which only ever read
+ * what they copy, so never touch its reference counts. Each environment
+ * is copied once, which keeps the cycles between closures and the
+ * environments they are bound in. The copier holds a reference to every
+ * environment it made until par_copier_clear */
+typedef struct {
+    /* the copies made so far, by the address of what they copy */
+    par_map envs;
+    /* and the other way round */
+    par_map originals;
+    /* copies made the other way, which copy back to their originals */
+    const par_map* known;
+    /* if set, only the bindings of these names are copied into frames */
+    const par_map* names;
+    /* the first value that could not be copied, which fails the copy as
+     * a whole */
+    awlval* err;
+} par_copier;
+
+static awlval* par_fail(par_copier* c, awlval* err) {
+    if (c->err) {
+        awlval_del(err);
+    } else {
+        c->err = err;
+    }
+    return awlval_qexpr();
+}
+
+static bool par_copies(const par_copier* c, const char* name) {
+    return !c->names || par_named(c->names, name);
+}
+
+static awlval* par_copy(par_copier* c, const awlval* v);
+
+static awlenv* par_copy_env(par_copier* c, awlenv* e) {
+    awlenv* n = c->known ? par_map_get(c->known, e) : NULL;
+    if (!n) {
+        n = par_map_get(&c->envs, e);
+    }
+    if (n) {
+        n->references++;
+        return n;
+    }
+
+    n = awlenv_new();
+    par_map_put(&c->envs, e, n);
+    par_map_put(&c->originals, n, e);
+    n->top_level = e->top_level;
+
+    if (e->slot_names) {
+        n->slot_names = par_copy(c, e->slot_names);
+        n->slots = pool_alloc(sizeof(awlval*) * e->slot_names->count);
+        for (int i = 0; i < e->slot_names->count; i++) {
+            n->slots[i] = e->slots[i] && par_copies(c, e->slot_names->cell[i]->sym)
+                ? par_copy(c, e->slots[i]) : NULL;
+        }
+    }
+
+    if (e->internal_dict) {
+        dict* d = e->internal_dict;
+        for (int i = 0; i < d->size; i++) {
+            if (d->syms[i] && par_copies(c, d->syms[i])) {
+                awlval* k = awlval_sym(d->syms[i]);
+                awlval* v = par_copy(c, d->vals[i]);
+                awlenv_put(n, k, v);
+                awlval_del(k);
+                awlval_del(v);
+            }
+        }
+    }
+
+    if (e->parent) {
+        n->parent = par_copy_env(c, e->parent);
+    }
+
+    n->references++;
+    return n;
+}
+
+typedef struct {
+    par_copier* copier;
+    awlval* dict;
+} par_dict_copy;
+
+static void par_copy_entry(char* k, awlval* v, void* data) {
+    par_dict_copy* d = data;
+    awlval* key = awlval_qsym(k);
+    awlval* val = par_copy(d->copier, v);
+    awlval_add_dict(d->dict, key, val);
+    awlval_del(key);
+    awlval_del(val);
+}
+
+static awlval* par_copy(par_copier* c, const awlval* v) {
+    switch (v->type) {
+        case AWLVAL_INT:
+            return awlval_int(v->lng);
+        case AWLVAL_FLOAT:
+            return awlval_float(v->dbl);
+        case AWLVAL_BOOL:
+            return awlval_bool(v->bln);
+        case AWLVAL_ERR:
+            return awlval_err("%s", v->err);
+        case AWLVAL_SYM:
+            return awlval_sym(v->sym);
+        case AWLVAL_QSYM:
+            return awlval_qsym(v->sym);
+        case AWLVAL_STR:
+            return awlval_strn(v->str, v->length);
+        case AWLVAL_BUILTIN:
+            return awlval_fun(v->builtin, v->builtin_name);
+
+        case AWLVAL_FN:
+        case AWLVAL_MACRO:
+            {
+                /* the copy takes its shape from v, and its parts from the
+                 * copies, which the template only borrows */
+                awlval shape = *v;
+                shape.formals = par_copy(c, v->formals);
+                shape.body = par_copy(c, v->body);
+                awlval* x = awlval_applied(&shape, par_copy_env(c, v->env), v->bound);
+                x->called = v->called;
+                awlval_del(shape.formals);
+                awlval_del(shape.body);
+                return x;
+            }
+
+        case AWLVAL_DICT:
+            {
+                par_dict_copy d = { c, awlval_dict() };
+                if (v->map) {
+                    hamt_foreach(v->map, par_copy_entry, &d);
+                }
+                return d.dict;
+            }
+
+        case AWLVAL_CHAN:
+        case AWLVAL_GEN:
+            return par_fail(c, awlval_err("%s cannot be used in a parallel call",
+                    awlval_type_name(v->type)));
+
+        case AWLVAL_SEXPR:
+        case AWLVAL_QEXPR:
+        case AWLVAL_EEXPR:
+        case AWLVAL_CEXPR:
+            {
+                awlval* x = v->type == AWLVAL_SEXPR ? awlval_sexpr()
+                    : v->type == AWLVAL_QEXPR ? awlval_qexpr()
+                    : v->type == AWLVAL_EEXPR ? awlval_eexpr()
+                    : awlval_cexpr();
+                for (int i = 0; i < v->count; i++) {
+                    x = awlval_add(x, par_copy(c, v->cell[i]));
+                }
+                x->evaluated = v->evaluated;
+                return x;
+            }
+    }
+
+    return par_fail(c, awlval_err("cannot copy %s to another thread", awlval_type_name(v->type)));
+}
+
+/* lets go of the environments c made; those only held by each other are
+ * left for the collector */
+static void par_copier_clear(par_copier* c) {
+    for (int i = 0; i < c->envs.size; i++) {
+        if (c->envs.keys[i]) {
+            ((awlenv*)c->envs.vals[i])->top_level = false;
+        }
+    }
+    for (int i = 0; i < c->envs.size; i++) {
+        if (c->envs.keys[i]) {
+            awlenv_del(c->envs.vals[i]);
+        }
+    }
+    par_map_clear(&c->envs);
+    par_map_clear(&c->originals);
+    if (c->err) {
+        awlval_del(c->err);
+        c->err = NULL;
+    }
+}
+
+typedef enum {
+    PAR_PENDING,
+    PAR_RUNNING,
+    PAR_DONE,
+    PAR_COPIED
+} par_state;
+
+typedef struct {
+    int start;
+    int end;
+    par_state state;
+    /* the runtime running the chunk, to abort it with */
+    awl_runtime* rt;
+    /* once done, what it evaluated to, the originals of the environments
+     * it was given, and what to set once both are no longer needed; all
+     * of them the worker's */
+    awlval* result;
+    const par_map* originals;
+    bool* copied;
+} par_chunk;
+
+/* One call's chunks. The caller waits for every chunk to be copied back,
+ * so what it passed stays as it is until then */
+typedef struct par_batch {
+    unsigned long id;
+    awlenv* env;
+    awlval* f;
+    awlval* l;
+    awlval* init;
+    /* what to copy of each frame, see par_scope */
+    const par_map* names;
+    par_chunk_fn fn;
+    bool vm;
+    void (*print_fn)(char*);
+
+    par_chunk* chunks;
+    int count;
+    /* the first chunk no worker has started */
+    int next;
+    bool aborted;
+    struct par_batch* next_batch;
+} par_batch;
+
+/* The pool is the process's; everything below is guarded by lock */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+/* a chunk is ready to run, or one has been copied back */
+static pthread_cond_t work = PTHREAD_COND_INITIALIZER;
+/* a chunk has been run */
+static pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+
+static pthread_t* workers = NULL;
+static int started = 0;
+static int size = 0;
+static bool stopping = false;
+
+/* batches with chunks left to start, oldest first */
+static par_batch* queue = NULL;
+static par_batch* queue_last = NULL;
+static unsigned long batches = 0;
+
+static _Thread_local bool in_worker = false;
+
+/* What a worker copied for the batch it last ran a chunk of, kept for
+ * the rest of that batch's chunks */
+typedef struct {
+    unsigned long batch;
+    par_copier copier;
+    awlenv* env;
+    awlval* f;
+    awlval* init;
+} par_held;
+
+static void par_hold(par_held* h, par_batch* b) {
+    memset(&h->copier, 0, sizeof(par_copier));
+    h->copier.names = b->names;
+    h->batch = b->id;
+    h->env = par_copy_env(&h->copier, b->env);
+    h->f = par_copy(&h->copier, b->f);
+    h->init = b->init ? par_copy(&h->copier, b->init) : NULL;
+
+    vm_enable(b->vm);
+    awl_rt->print_fn = b->print_fn;
+}
+
+static void par_release(par_held* h) {
+    if (!h->batch) {
+        return;
+    }
+
+    awlval_del(h->f);
+    if (h->init) {
+        awlval_del(h->init);
+    }
+    awlenv_del(h->env);
+    par_copier_clear(&h->copier);
+    h->copier.names = NULL;
+    awlval_expansions_clear();
+    gc_collect();
+    h->batch = 0;
+}
+
+static awlval* par_run_chunk(par_held* h, par_batch* b, par_chunk* c) {
+    awlval* part = awlval_qexpr();
+    for (int i = c->start; i < c->end; i++) {
+        part = awlval_add(part, par_copy(&h->copier, b->l->cell[i]));
+    }
+
+    if (h->copier.err) {
+        awlval_del(part);
+        return awlval_retain(h->copier.err);
+    }
+
+    unsigned long mark = awlenv_freeze();
+    awlval* r = par_checked(b->fn(h->env, h->f, part, 0, part->count, h->init));
+    awlenv_thaw(mark);
+    awlval_del(part);
+    return r;
+}
+
+static void* par_worker_main(void* arg) {
+    (void)arg;
+    awl_runtime* rt = awl_runtime_new();
+    awlval_eval_depth_swap(awlval_eval_depth_new(PAR_STACK_SIZE));
+    in_worker = true;
+    par_held held = { 0 };
+
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        if (!queue) {
+            if (held.batch) {
+                /* nothing is left of the batch the copies were made for */
+                pthread_mutex_unlock(&lock);
+                par_release(&held);
+                pthread_mutex_lock(&lock);
+            } else if (stopping) {
+                break;
+            } else {
+                pthread_cond_wait(&work, &lock);
+            }
+            continue;
+        }
+
+        par_batch* b = queue;
+        par_chunk* c = &b->chunks[b->next++];
+        if (b->next == b->count) {
+            queue = b->next_batch;
+        }
+        c->state = PAR_RUNNING;
+        c->rt = rt;
+        /* an abort meant for an earlier chunk is not meant for this one */
+        atomic_store(&rt->eval_aborted, 0);
+        bool aborted = b->aborted;
+        pthread_mutex_unlock(&lock);
+
+        if (held.batch != b->id) {
+            par_release(&held);
+            par_hold(&held, b);
+        }
+        awlval* r = aborted ? awlval_err("eval aborted") : par_run_chunk(&held, b, c);
+
+        /* the caller copies r back while the worker waits; after that the
+         * batch may be gone, so only copied is looked at */
+        bool copied = false;
+        pthread_mutex_lock(&lock);
+        c->rt = NULL;
+        c->result = r;
+        c->originals = &held.copier.originals;
+        c->copied = &copied;
+        c->state = PAR_DONE;
+        pthread_cond_broadcast(&done);
+        while (!copied) {
+            pthread_cond_wait(&work, &lock);
+        }
+        pthread_mutex_unlock(&lock);
+
+        awlval_del(r);
+        pthread_mutex_lock(&lock);
+    }
+    pthread_mutex_unlock(&lock);
+
+    par_release(&held);
+    awl_runtime_del(rt);
+    return NULL;
+}
+
+static int par_processors(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n < 1 ? 1 : n > PAR_MAX_WORKERS ? PAR_MAX_WORKERS : (int)n;
+}
+
+int par_workers(void) {
+    pthread_mutex_lock(&lock);
+    int n = size > 0 ? size : par_processors();
+    pthread_mutex_unlock(&lock);
+    return n;
+}
+
+/* called with lock held */
+static void par_start(int n) {
+    workers = safe_malloc(sizeof(pthread_t) * n);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, PAR_STACK_SIZE);
+    for (int i = 0; i < n; i++) {
+        if (pthread_create(&workers[started], &attr, par_worker_main, NULL) == 0) {
+            started++;
+        }
+    }
+    pthread_attr_destroy(&attr);
+}
+
+static void par_stop(void) {
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_broadcast(&work);
+    pthread_mutex_unlock(&lock);
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    pthread_mutex_lock(&lock);
+    free(workers);
+    workers = NULL;
+    started = 0;
+    stopping = false;
+    pthread_mutex_unlock(&lock);
+}
+
+void par_set_workers(int n) {
+    par_stop();
+    pthread_mutex_lock(&lock);
+    size = n > PAR_MAX_WORKERS ? PAR_MAX_WORKERS : n;
+    pthread_mutex_unlock(&lock);
+}
+
+void teardown_par(void) {
+    par_stop();
+}
+
+static awlval* par_copy_back(awlval* r, const par_map* originals) {
+    par_copier c;
+    memset(&c, 0, sizeof(par_copier));
+    c.known = originals;
+    awlval* x = par_copy(&c, r);
+    if (c.err) {
+        awlval_del(x);
+        x = c.err;
+        c.err = NULL;
+    }
+    par_copier_clear(&c);
+    return x;
+}
+
+/* Runs the chunks on the pool, or returns NULL if it has no workers */
+static awlval* par_run(awlenv* e, awlval* f, awlval* l, awlval* init,
+        const par_map* names, par_chunk_fn chunk, int count, int n) {
+    par_chunk* chunks = safe_malloc(sizeof(par_chunk) * count);
+    awlval** results = safe_malloc(sizeof(awlval*) * count);
+    for (int i = 0; i < count; i++) {
+        chunks[i].start = (int)((long)i * n / count);
+        chunks[i].end = (int)((long)(i + 1) * n / count);
+        chunks[i].state = PAR_PENDING;
+        chunks[i].rt = NULL;
+        chunks[i].result = NULL;
+        chunks[i].originals = NULL;
+        chunks[i].copied = NULL;
+    }
+
+    par_batch b = { 0, e, f, l, init, names, chunk, vm_enabled(), awl_rt->print_fn,
+        chunks, count, 0, false, NULL };
+
+    pthread_mutex_lock(&lock);
+    if (!started) {
+        par_start(size > 0 ? size : par_processors());
+    }
+    if (!started) {
+        pthread_mutex_unlock(&lock);
+        free(chunks);
+        free(results);
+        return NULL;
+    }
+
+    b.id = ++batches;
+    if (queue) {
+        queue_last->next_batch = &b;
+    } else {
+        queue = &b;
+    }
+    queue_last = &b;
+    pthread_cond_broadcast(&work);
+
+    int copied = 0;
+    while (copied < count) {
+        par_chunk* c = NULL;
+        for (int i = 0; i < count && !c; i++) {
+            if (chunks[i].state == PAR_DONE) {
+                c = &chunks[i];
+            }
+        }
+
+        if (c) {
+            pthread_mutex_unlock(&lock);
+            results[c - chunks] = par_copy_back(c->result, c->originals);
+            pthread_mutex_lock(&lock);
+
+            c->state = PAR_COPIED;
+            *c->copied = true;
+            copied++;
+            pthread_cond_broadcast(&work);
+            continue;
+        }
+
+        if (!b.aborted && atomic_exchange(&awl_rt->eval_aborted, 0)) {
+            /* acted on here, in place of the caller's next safe point */
+            b.aborted = true;
+            for (int i = 0; i < count; i++) {
+                if (chunks[i].rt) {
+                    awl_runtime_abort(chunks[i].rt);
+                }
+            }
+            continue;
+        }
+
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += PAR_POLL_NSEC;
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&done, &lock, &until);
+    }
+    pthread_mutex_unlock(&lock);
+
+    awlval* r = awlval_qexpr();
+    for (int i = count - 1; i >= 0; i--) {
+        if (r->type == AWLVAL_ERR) {
+            awlval_del(results[i]);
+        } else if (results[i]->type == AWLVAL_ERR) {
+            awlval_del(r);
+            r = results[i];
+        } else {
+            r = awlval_add_front(r, results[i]);
+        }
+    }
+
+    if (b.aborted && r->type != AWLVAL_ERR) {
+        awlval_del(r);
+        r = awlval_err("eval aborted");
+    }
+
+    free(chunks);
+    free(results);
+    return r;
+}
+
+awlval* par_chunks(awlenv* e, awlval* f, awlval* l, awlval* init, par_chunk_fn chunk) {
+    /* chunks of at least PAR_MIN_CHUNK cells, and no more than
+     * PAR_MAX_CHUNKS of them, so long lists spread across the pool while
+     * short ones do not pay for copies they cannot make up for */
+    int n = l->count;
+    int count = (n + PAR_MIN_CHUNK - 1) / PAR_MIN_CHUNK;
+    count = count < PAR_MAX_CHUNKS ? count : PAR_MAX_CHUNKS;
+
+    par_scope s;
+    memset(&s, 0, sizeof(par_scope));
+    par_scope_value(&s, f);
+    par_scope_value(&s, l);
+    if (init) {
+        par_scope_value(&s, init);
+    }
+    par_scope_env(&s, e);
+    if (s.err) {
+        awlval* err = s.err;
+        s.err = NULL;
+        par_scope_clear(&s);
+        return err;
+    }
+
+    awlval* r = NULL;
+    if (count > 1 && !in_worker && par_workers() > 1) {
+        r = par_run(e, f, l, init, &s.names, chunk, count, n);
+    }
+    par_scope_clear(&s);
+    if (r) {
+        return r;
+    }
+
+    /* chunks see the frames they are given as they would on the pool */
+    unsigned long mark = awlenv_freeze();
+    r = awlval_qexpr();
+    for (int i = count - 1; i >= 0; i--) {
+        awlval* x = par_checked(chunk(e, f, l, (int)((long)i * n / count),
+                (int)((long)(i + 1) * n / count), init));
+        if (x->type == AWLVAL_ERR) {
+            awlval_del(r);
+            r = x;
+            break;
+        }
+        awlval_add_front(r, x);
+    }
+    awlenv_thaw(mark);
+    return r;
+}
@@ -0,0 +1,45 @@
+#ifndef AWL_PAR_H
+#define AWL_PAR_H
+
+#include "types.h"
+
+/* A list is split into chunks whose bounds depend on its length alone, so
+ * that how the results combine is the same however many workers there
+ * are. A chunk runs on a worker thread of a pool shared by every
+ * interpreter; each worker is an interpreter of its own (see
+ * awl_runtime_new), and works on deep copies of the function, the
+ * elements and, of the frames the function can see, the bindings of the
+ * names it can reach, made while the caller waits. What a chunk evaluates
+ * to is copied back the same way, with environments copied from the
+ * caller mapped back to the originals.
+ *
+ * So that a call gives the same on whichever path it runs, the frames
+ * that were there before it are frozen while its chunks run (see
+ * awlenv_freeze), and a channel or generator the function could reach, or
+ * that a chunk evaluates to, fails the whole call. Names made while a
+ * chunk runs, as by convert, are only looked up in what was copied */
+#define PAR_MIN_CHUNK 16
+#define PAR_MAX_CHUNKS 64
+#define PAR_MAX_WORKERS 64
+#define PAR_STACK_SIZE (8L * 1024 * 1024)
+
+/* what one chunk of a list evaluates to, from the cells in [start, end) */
+typedef awlval*(*par_chunk_fn)(awlenv* e, awlval* f, awlval* l, int start, int end, awlval* init);
+
+/* A Q-expression of what chunk gives for each chunk of l, in order, or the
+ * error of the last chunk to fail, as a builtin that starts from the end
+ * of the list would report. Chunks run one after the other in the
+ * calling thread when there is only the one, when the pool has a single
+ * worker or when the caller is a worker itself. init may be NULL */
+awlval* par_chunks(awlenv* e, awlval* f, awlval* l, awlval* init, par_chunk_fn chunk);
+
+/* 0 or less resets the pool to a worker per processor online; the pool is
+ * started again, at the new size, the next time it is needed. Only called
+ * while nothing is running on it */
+void par_set_workers(int n);
+int par_workers(void);
+
+/* stops the workers, each deleting its runtime */
+void teardown_par(void);
+
+#endif
@@ -6,8 +6,11 @@
 
 #include "mpc.h"
 #include "assert.h"
+#include "fold.h"
 #include "util.h"
 
+/* built once by setup_parser, and after that only read, so the threads
+ * running interpreters all parse with the same grammar */
 static mpc_parser_t* Integer;
 static mpc_parser_t* FPoint;
 static mpc_parser_t* Number;
@@ -214,6 +217,9 @@ bool awlval_parse(const char* input, awlval** v, char** err) {
     if (mpc_parse("<stdin>", input, Awl, &r)) {
         *v = awlval_read(r.output);
         mpc_ast_delete(r.output);
+        if (fold_enabled()) {
+            awlval_fold(*v);
+        }
         return true;
     } else {
         *err = mpc_err_string(r.error);
@@ -227,6 +233,9 @@ bool awlval_parse_file(const char* file, awlval** v, char** err) {
     if (mpc_parse_contents(file, Awl, &r)) {
         *v = awlval_read(r.output);
         mpc_ast_delete(r.output);
+        if (fold_enabled()) {
+            awlval_fold(*v);
+        }
         return true;
     } else {
         *err = mpc_err_string(r.error);
@@ -0,0 +1,119 @@
+#include "pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+typedef struct pool_block {
+    struct pool_block* next;
+} pool_block;
+
+typedef struct pool_slab {
+    struct pool_slab* next;
+} pool_slab;
+
+static _Thread_local pool_block* free_lists[POOL_CLASSES];
+static _Thread_local char* slab_cursor[POOL_CLASSES];
+static _Thread_local char* slab_end[POOL_CLASSES];
+static _Thread_local pool_slab* slabs = NULL;
+static _Thread_local pool_stats_t stats;
+
+#ifndef AWL_NO_POOL
+static int pool_class(size_t size) {
+    return (size + POOL_GRANULARITY - 1) / POOL_GRANULARITY - 1;
+}
+
+static void* pool_carve(int c) {
+    size_t block_size = (c + 1) * POOL_GRANULARITY;
+
+    if (slab_cursor[c] == NULL || slab_cursor[c] + block_size > slab_end[c]) {
+        /* the slab header is padded so blocks stay suitably aligned */
+        pool_slab* slab = safe_malloc(POOL_GRANULARITY + POOL_SLAB_SIZE);
+        slab->next = slabs;
+        slabs = slab;
+        stats.slabs++;
+
+        slab_cursor[c] = (char*)slab + POOL_GRANULARITY;
+        slab_end[c] = slab_cursor[c] + POOL_SLAB_SIZE;
+    }
+
+    void* p = slab_cursor[c];
+    slab_cursor[c] += block_size;
+    return p;
+}
+#endif
+
+void* pool_alloc(size_t size) {
+    if (size == 0) {
+        return NULL;
+    }
+#ifndef AWL_NO_POOL
+    if (size <= POOL_MAX_SIZE) {
+        int c = pool_class(size);
+        pool_block* b = free_lists[c];
+        if (b) {
+            free_lists[c] = b->next;
+            stats.hits++;
+            return b;
+        }
+
+        stats.misses++;
+        return pool_carve(c);
+    }
+#endif
+    stats.large++;
+    return safe_malloc(size);
+}
+
+void pool_free(void* p, size_t size) {
+    if (p == NULL) {
+        return;
+    }
+#ifndef AWL_NO_POOL
+    if (size <= POOL_MAX_SIZE) {
+        pool_block* b = p;
+        b->next = free_lists[pool_class(size)];
+        free_lists[pool_class(size)] = b;
+        return;
+    }
+#endif
+    free(p);
+}
+
+void* pool_realloc(void* p, size_t oldsize, size_t newsize) {
+    if (p == NULL) {
+        return pool_alloc(newsize);
+    }
+#ifndef AWL_NO_POOL
+    /* blocks within the same size class can be reused as they are */
+    if (oldsize <= POOL_MAX_SIZE && newsize <= POOL_MAX_SIZE &&
+            newsize != 0 && pool_class(oldsize) == pool_class(newsize)) {
+        return p;
+    }
+#endif
+
+    void* n = pool_alloc(newsize);
+    if (n) {
+        memcpy(n, p, oldsize < newsize ? oldsize : newsize);
+    }
+    pool_free(p, oldsize);
+    return n;
+}
+
+pool_stats_t pool_get_stats(void) {
+    return stats;
+}
+
+void teardown_pool(void) {
+    while (slabs) {
+        pool_slab* next = slabs->next;
+        free(slabs);
+        slabs = next;
+    }
+    for (int c = 0; c < POOL_CLASSES; c++) {
+        free_lists[c] = NULL;
+        slab_cursor[c] = NULL;
+        slab_end[c] = NULL;
+    }
+}
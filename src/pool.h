@@ -0,0 +1,27 @@
+#ifndef AWL_POOL_H
+#define AWL_POOL_H
+
+#include <stddef.h>
+
+/* Small allocations are served from per-size-class free lists, carved out
+ * of larger slabs; anything bigger than POOL_MAX_SIZE goes to malloc */
+#define POOL_GRANULARITY 16
+#define POOL_CLASSES 16
+#define POOL_MAX_SIZE (POOL_GRANULARITY * POOL_CLASSES)
+#define POOL_SLAB_SIZE (64 * 1024)
+
+typedef struct {
+    long hits;
+    long misses;
+    long large;
+    long slabs;
+} pool_stats_t;
+
+void* pool_alloc(size_t size);
+void pool_free(void* p, size_t size);
+void* pool_realloc(void* p, size_t oldsize, size_t newsize);
+
+pool_stats_t pool_get_stats(void);
+void teardown_pool(void);
+
+#endif
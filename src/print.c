@@ -6,22 +6,22 @@
 
 #include "mpc.h"
 #include "assert.h"
+#include "hamt.h"
+#include "runtime.h"
 #include "util.h"
 
 #define BUFSIZE 4096
 
-static void (*print_fn)(char*);
-
 static void default_print_fn(char* s) {
     fputs(s, stdout);
 }
 
 void register_print_fn(void (*fn)(char*)) {
-    print_fn = fn;
+    awl_rt->print_fn = fn;
 }
 
 void register_default_print_fn(void) {
-    print_fn = &default_print_fn;
+    awl_rt->print_fn = &default_print_fn;
 }
 
 void awl_printf(const char* format, ...) {
@@ -31,7 +31,7 @@ void awl_printf(const char* format, ...) {
     va_start(arguments, format);
 
     vsnprintf(buffer, BUFSIZE, format, arguments);
-    print_fn(buffer);
+    awl_rt->print_fn(buffer);
 
     va_end(arguments);
     free(buffer);
@@ -39,12 +39,12 @@ void awl_printf(const char* format, ...) {
 
 void awlval_println(const awlval* v) {
     awlval_print(v);
-    print_fn("\n");
+    awl_rt->print_fn("\n");
 }
 
 void awlval_print(const awlval* v) {
     char* str = awlval_to_str(v);
-    print_fn(str);
+    awl_rt->print_fn(str);
     free(str);
 }
 
@@ -62,32 +62,51 @@ static void awlval_expr_print(stringbuilder_t* sb, const awlval* v, const char*
     stringbuilder_write(sb, close);
 }
 
-static void awlval_dict_print(stringbuilder_t* sb, const dict* d) {
-    stringbuilder_write(sb, "[");
-
-    int count = dict_count(d);
-    char** keys = dict_all_keys(d);
-    awlval** vals = (awlval**)dict_all_vals(d);
-
-    for (int i = 0; i < count; i++) {
-        stringbuilder_write(sb, ":'%s'", keys[i]);
-        stringbuilder_write(sb, " ");
-        awlval_write_sb(sb, vals[i]);
+/* only the formals a function has yet to be applied to */
+static void awlval_formals_print(stringbuilder_t* sb, const awlval* f) {
+    bool qexpr = f->formals->type == AWLVAL_QEXPR;
+    stringbuilder_write(sb, qexpr ? "{" : "(");
+    for (int i = f->bound; i < f->formals->count; i++) {
+        awlval_write_sb(sb, f->formals->cell[i]);
 
-        if (i != (count - 1)) {
+        if (i != (f->formals->count - 1)) {
             stringbuilder_write(sb, " ");
         }
     }
+    stringbuilder_write(sb, qexpr ? "}" : ")");
+}
+
+typedef struct {
+    stringbuilder_t* sb;
+    bool first;
+} awlval_dict_print_t;
+
+static void awlval_dict_print_entry(char* k, awlval* v, void* data) {
+    awlval_dict_print_t* state = data;
+    if (!state->first) {
+        stringbuilder_write(state->sb, " ");
+    }
+    state->first = false;
 
-    free(keys);
-    free(vals);
+    stringbuilder_write(state->sb, ":'%s'", k);
+    stringbuilder_write(state->sb, " ");
+    awlval_write_sb(state->sb, v);
+}
+
+static void awlval_dict_print(stringbuilder_t* sb, const hamt_node* map) {
+    stringbuilder_write(sb, "[");
+
+    awlval_dict_print_t state = { sb, true };
+    hamt_foreach(map, awlval_dict_print_entry, &state);
 
     stringbuilder_write(sb, "]");
 }
 
 static void awlval_print_str(stringbuilder_t* sb, const awlval* v) {
-    char* escaped = safe_malloc(strlen(v->str) + 1);
-    strcpy(escaped, v->str);
+    /* the characters may be a substring of a larger buffer */
+    char* escaped = safe_malloc(v->length + 1);
+    memcpy(escaped, v->str, v->length);
+    escaped[v->length] = '\0';
 
     escaped = mpcf_escape(escaped);
     stringbuilder_write(sb, "\"%s\"", escaped);
@@ -135,7 +154,7 @@ static void awlval_write_sb(stringbuilder_t* sb, const awlval* v) {
 
         case AWLVAL_FN:
             stringbuilder_write(sb, "(fn ");
-            awlval_write_sb(sb, v->formals);
+            awlval_formals_print(sb, v);
             stringbuilder_write(sb, " ");
             awlval_write_sb(sb, v->body);
             stringbuilder_write(sb, ")");
@@ -143,14 +162,22 @@ static void awlval_write_sb(stringbuilder_t* sb, const awlval* v) {
 
         case AWLVAL_MACRO:
             stringbuilder_write(sb, "(macro ");
-            awlval_write_sb(sb, v->formals);
+            awlval_formals_print(sb, v);
             stringbuilder_write(sb, " ");
             awlval_write_sb(sb, v->body);
             stringbuilder_write(sb, ")");
             break;
 
         case AWLVAL_DICT:
-            awlval_dict_print(sb, v->d);
+            awlval_dict_print(sb, v->map);
+            break;
+
+        case AWLVAL_CHAN:
+            stringbuilder_write(sb, "<chan>");
+            break;
+
+        case AWLVAL_GEN:
+            stringbuilder_write(sb, "<gen>");
             break;
 
         case AWLVAL_SEXPR:
@@ -11,6 +11,7 @@
 #include "print.h"
 #include "eval.h"
 #include "util.h"
+#include "vm.h"
 
 #define HIST_FILE "awl.hist"
 
@@ -67,7 +68,7 @@ awlval* eval_repl(awlenv* e, awlval* v) {
         awlval_del(v);
         return awlval_err("too many expressions in REPL; only one is allowed");
     }
-    return awlval_eval(e, awlval_take(v, 0));
+    return vm_eval_top(e, awlval_take(v, 0));
 }
 
 void eval_repl_str(awlenv* e, const char* input) {
@@ -85,18 +86,21 @@ void eval_repl_str(awlenv* e, const char* input) {
     }
 }
 
+/* the terminal belongs to the one REPL, whichever thread the signal is
+ * delivered to */
+static awl_runtime* repl_runtime = NULL;
+
 static void sigint_handler(int ignore) {
-    awlval_eval_abort();
+    awl_runtime_abort(repl_runtime);
 }
 
 static void setup_sigint_handler(void) {
+    repl_runtime = awl_rt;
     signal(SIGINT, sigint_handler);
 }
 
-static bool repl_aborted = false;
-
 void abort_repl(void) {
-    repl_aborted = true;
+    atomic_store(&awl_rt->repl_aborted, 1);
 }
 
 void run_repl(awlenv* e) {
@@ -107,7 +111,7 @@ void run_repl(awlenv* e) {
 
     load_history();
 
-    while (!repl_aborted) {
+    while (!atomic_load(&awl_rt->repl_aborted)) {
         errno = 0;
         char* input = get_input("awl> ");
         if (!input) {
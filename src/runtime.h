@@ -0,0 +1,30 @@
+#ifndef AWL_RUNTIME_H
+#define AWL_RUNTIME_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/* An interpreter, as seen from outside it. Everything else an interpreter
+ * changes as it runs (its pools, symbols, collector, caches and tasks) is
+ * kept per thread, so a thread runs one interpreter at a time: the one it
+ * made current. The grammar is built once, by setup_awl, and after that
+ * only read, so every interpreter shares it */
+typedef struct awl_runtime {
+    void (*print_fn)(char*);
+
+    /* set from other threads or signal handlers, and acted on at the next
+     * safe point; pending is set after either of the others, so that
+     * evaluation only has the one to check */
+    atomic_int eval_pending;
+    atomic_int eval_aborted;
+    atomic_int eval_preempted;
+    atomic_int repl_aborted;
+
+    /* xorshift state for 'random'; never zero */
+    uint64_t rand_state;
+} awl_runtime;
+
+/* the runtime current on the calling thread */
+extern _Thread_local awl_runtime* awl_rt;
+
+#endif
@@ -0,0 +1,617 @@
+/* ucontext, sigaction and the timers are POSIX rather than C11, and a
+ * timer that signals the one thread is Linux's */
+#define _GNU_SOURCE
+
+#include "sched.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <ucontext.h>
+
+#include "eval.h"
+#include "gc.h"
+#include "util.h"
+
+#define SCHED_CHAN_INITIAL_SIZE 8
+
+typedef struct sched_task {
+    ucontext_t context;
+    /* NULL for the main task, which runs on the process stack */
+    void* stack;
+    eval_depth_t depth;
+
+    /* what the task applies, until it starts, and where the result goes */
+    awlenv* env;
+    awlval* f;
+    awlval* args;
+    awlval* result;
+
+    /* the generator the task is running, innermost first (see awlgen) */
+    awlgen* gen;
+
+    bool cancelled;
+    /* woken because no other task could run */
+    bool deadlocked;
+    awlchan* waiting_on;
+
+    /* in the run queue or the waiting list of a channel, never both */
+    struct sched_task* next;
+    /* every task spawned and not yet freed */
+    struct sched_task* all_prev;
+    struct sched_task* all_next;
+} sched_task;
+
+static _Thread_local sched_task main_task;
+static _Thread_local sched_task* current = NULL;
+
+static _Thread_local sched_task* runnable = NULL;
+static _Thread_local sched_task* runnable_last = NULL;
+static _Thread_local sched_task* tasks = NULL;
+static _Thread_local long live_tasks = 0;
+static _Thread_local long slice = SCHED_SLICE_USEC;
+
+/* a task cannot free the stack it finishes on, so the next one does */
+static _Thread_local sched_task* finished = NULL;
+
+awlchan* awlchan_new(void) {
+    awlchan* c = safe_malloc(sizeof(awlchan));
+    c->refs = 1;
+    c->vals = NULL;
+    c->head = 0;
+    c->count = 0;
+    c->size = 0;
+    c->waiting = NULL;
+    c->waiting_last = NULL;
+    return c;
+}
+
+awlchan* awlchan_retain(awlchan* c) {
+    c->refs++;
+    return c;
+}
+
+void awlchan_del(awlchan* c) {
+    if (--c->refs > 0) {
+        return;
+    }
+
+    for (int i = 0; i < c->count; i++) {
+        awlval_del(c->vals[(c->head + i) % c->size]);
+    }
+    free(c->vals);
+    free(c);
+}
+
+static void sched_push(sched_task* t) {
+    t->next = NULL;
+    if (runnable_last) {
+        runnable_last->next = t;
+    } else {
+        runnable = t;
+    }
+    runnable_last = t;
+}
+
+static sched_task* sched_pop(void) {
+    sched_task* t = runnable;
+    if (t) {
+        runnable = t->next;
+        if (!runnable) {
+            runnable_last = NULL;
+        }
+    }
+    return t;
+}
+
+/* takes t off the waiting list of the channel it waits on, if any */
+static void sched_unwait(sched_task* t) {
+    awlchan* c = t->waiting_on;
+    if (!c) {
+        return;
+    }
+    t->waiting_on = NULL;
+
+    sched_task* prev = NULL;
+    for (sched_task* w = c->waiting; w; prev = w, w = w->next) {
+        if (w != t) {
+            continue;
+        }
+        if (prev) {
+            prev->next = t->next;
+        } else {
+            c->waiting = t->next;
+        }
+        if (c->waiting_last == t) {
+            c->waiting_last = prev;
+        }
+        break;
+    }
+}
+
+/* The task to run once the running one stops; with none left runnable,
+ * the main task is waiting for something no task will send, so it is
+ * woken to report as much */
+static sched_task* sched_next(void) {
+    sched_task* t = sched_pop();
+    if (t) {
+        return t;
+    }
+    sched_unwait(&main_task);
+    main_task.deadlocked = true;
+    return &main_task;
+}
+
+static void sched_reap(void) {
+    if (!finished) {
+        return;
+    }
+
+    if (finished->all_prev) {
+        finished->all_prev->all_next = finished->all_next;
+    } else {
+        tasks = finished->all_next;
+    }
+    if (finished->all_next) {
+        finished->all_next->all_prev = finished->all_prev;
+    }
+    free(finished->stack);
+    free(finished);
+    finished = NULL;
+}
+
+static void sched_switch(sched_task* t) {
+    sched_task* from = current;
+    current = t;
+    from->depth = awlval_eval_depth_swap(t->depth);
+    swapcontext(&from->context, &t->context);
+    sched_reap();
+}
+
+void setup_sched(void) {
+    current = &main_task;
+}
+
+/* Time slices are measured in CPU time, and only while there are tasks to
+ * share it with. Where a timer can signal a single thread, each thread
+ * times its own tasks; elsewhere the one timer of the process preempts
+ * whichever thread it happens to signal */
+static void sched_tick(int sig) {
+    if (awl_rt) {
+        awlval_eval_preempt();
+    }
+}
+
+#ifdef SIGEV_THREAD_ID
+/* older glibc only names the field this way */
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+static _Thread_local timer_t timer;
+static _Thread_local bool timer_created = false;
+#endif
+
+static void sched_timer(bool on) {
+    if (on) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = sched_tick;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGVTALRM, &action, NULL);
+    }
+
+#ifdef SIGEV_THREAD_ID
+    if (!timer_created) {
+        if (!on) {
+            return;
+        }
+        struct sigevent event;
+        memset(&event, 0, sizeof(event));
+        event.sigev_notify = SIGEV_THREAD_ID;
+        event.sigev_signo = SIGVTALRM;
+        event.sigev_notify_thread_id = gettid();
+        timer_created = timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &timer) == 0;
+        if (!timer_created) {
+            return;
+        }
+    }
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (on) {
+        spec.it_interval.tv_sec = slice / 1000000;
+        spec.it_interval.tv_nsec = slice % 1000000 * 1000;
+        spec.it_value = spec.it_interval;
+    }
+    timer_settime(timer, 0, &spec, NULL);
+#else
+    struct itimerval spec;
+    memset(&spec, 0, sizeof(spec));
+    if (on) {
+        spec.it_interval.tv_sec = slice / 1000000;
+        spec.it_interval.tv_usec = slice % 1000000;
+        spec.it_value = spec.it_interval;
+    }
+    setitimer(ITIMER_VIRTUAL, &spec, NULL);
+#endif
+}
+
+void sched_set_slice(long usec) {
+    slice = usec > 0 ? usec : SCHED_SLICE_USEC;
+    if (live_tasks > 0) {
+        sched_timer(true);
+    }
+}
+
+long sched_slice(void) {
+    return slice;
+}
+
+static void sched_task_main(void) {
+    sched_reap();
+
+    sched_task* t = current;
+    awlval* x;
+    if (t->cancelled) {
+        awlval_del(t->f);
+        awlval_del(t->args);
+        x = awlval_err("task cancelled");
+    } else {
+        x = awlval_apply(t->env, t->f, t->args);
+    }
+    t->f = NULL;
+    t->args = NULL;
+
+    sched_send(t->result->chan, x);
+    awlval_del(t->result);
+    awlenv_del(t->env);
+
+    if (--live_tasks == 0) {
+        sched_timer(false);
+    }
+    finished = t;
+    sched_switch(sched_next());
+}
+
+awlval* sched_spawn(awlenv* e, awlval* f, awlval* args) {
+    sched_task* t = safe_malloc(sizeof(sched_task));
+    t->stack = safe_malloc(SCHED_STACK_SIZE);
+    getcontext(&t->context);
+    t->context.uc_stack.ss_sp = t->stack;
+    t->context.uc_stack.ss_size = SCHED_STACK_SIZE;
+    t->context.uc_link = NULL;
+    makecontext(&t->context, sched_task_main, 0);
+    t->depth = awlval_eval_depth_new(SCHED_STACK_SIZE);
+
+    e->references++;
+    t->env = e;
+    t->f = f;
+    t->args = args;
+    t->result = awlval_chan();
+
+    t->gen = NULL;
+    t->cancelled = false;
+    t->deadlocked = false;
+    t->waiting_on = NULL;
+
+    t->all_prev = NULL;
+    t->all_next = tasks;
+    if (tasks) {
+        tasks->all_prev = t;
+    }
+    tasks = t;
+
+    if (live_tasks++ == 0) {
+        sched_timer(true);
+    }
+    sched_push(t);
+    return awlval_retain(t->result);
+}
+
+static awlval* sched_cancelled(void) {
+    return awlval_err("task cancelled");
+}
+
+awlval* sched_yield(void) {
+    if (current->cancelled) {
+        return sched_cancelled();
+    }
+
+    if (runnable) {
+        sched_push(current);
+        sched_switch(sched_pop());
+    }
+    return current->cancelled ? sched_cancelled() : NULL;
+}
+
+void sched_send(awlchan* c, awlval* v) {
+    if (c->count == c->size) {
+        int size = c->size ? c->size * 2 : SCHED_CHAN_INITIAL_SIZE;
+        awlval** vals = safe_malloc(sizeof(awlval*) * size);
+        for (int i = 0; i < c->count; i++) {
+            vals[i] = c->vals[(c->head + i) % c->size];
+        }
+        free(c->vals);
+        c->vals = vals;
+        c->head = 0;
+        c->size = size;
+    }
+    c->vals[(c->head + c->count++) % c->size] = v;
+
+    /* the first to wait is woken; the sender carries on */
+    sched_task* t = c->waiting;
+    if (t) {
+        sched_unwait(t);
+        sched_push(t);
+    }
+}
+
+awlval* sched_recv(awlchan* c) {
+    while (c->count == 0) {
+        if (current->cancelled) {
+            return sched_cancelled();
+        }
+        if (current == &main_task && !runnable) {
+            return awlval_err("deadlock; every task is waiting on a channel");
+        }
+
+        sched_task* next = sched_next();
+        current->waiting_on = c;
+        current->next = NULL;
+        if (c->waiting_last) {
+            c->waiting_last->next = current;
+        } else {
+            c->waiting = current;
+        }
+        c->waiting_last = current;
+        sched_switch(next);
+
+        if (current->deadlocked) {
+            current->deadlocked = false;
+            return awlval_err("deadlock; every task is waiting on a channel");
+        }
+    }
+
+    awlval* v = c->vals[c->head];
+    c->head = (c->head + 1) % c->size;
+    c->count--;
+    return v;
+}
+
+struct awlgen {
+    int refs;
+    ucontext_t context;
+    /* where the generator was resumed from, and how deep that was */
+    ucontext_t caller;
+    eval_depth_t caller_depth;
+    /* NULL until the generator first runs, and again once it finishes */
+    void* stack;
+    eval_depth_t depth;
+
+    awlenv* env;
+    awlval* f;
+    awlval* args;
+    /* passed to the caller each time the generator stops */
+    awlval* value;
+
+    bool running;
+    bool finished;
+    bool closed;
+    /* the generator running when this one was resumed */
+    awlgen* outer;
+
+    /* every generator not yet finished */
+    awlgen* all_prev;
+    awlgen* all_next;
+};
+
+static _Thread_local awlgen* gens = NULL;
+
+awlgen* awlgen_new(awlenv* e, awlval* f, awlval* args) {
+    awlgen* g = safe_malloc(sizeof(awlgen));
+    g->refs = 1;
+    g->stack = NULL;
+
+    e->references++;
+    g->env = e;
+    g->f = f;
+    g->args = args;
+    g->value = NULL;
+
+    g->running = false;
+    g->finished = false;
+    g->closed = false;
+    g->outer = NULL;
+    g->all_prev = NULL;
+    g->all_next = gens;
+    if (gens) {
+        gens->all_prev = g;
+    }
+    gens = g;
+    return g;
+}
+
+awlgen* awlgen_retain(awlgen* g) {
+    g->refs++;
+    return g;
+}
+
+/* Hands the value back to whoever resumed the generator; the generator's
+ * own context is only saved if it will carry on later */
+static void awlgen_return(awlgen* g, awlval* v) {
+    g->value = v;
+    g->depth = awlval_eval_depth_swap(g->caller_depth);
+    current->gen = g->outer;
+    if (g->finished) {
+        setcontext(&g->caller);
+    } else {
+        swapcontext(&g->context, &g->caller);
+    }
+}
+
+static void awlgen_main(void) {
+    awlgen* g = current->gen;
+    awlval* x = awlval_apply(g->env, g->f, g->args);
+    g->f = NULL;
+    g->args = NULL;
+
+    /* what the function evaluates to is only passed on if it is an error */
+    if (x->type != AWLVAL_ERR) {
+        awlval_del(x);
+        x = NULL;
+    }
+    g->finished = true;
+    awlgen_return(g, x);
+}
+
+static void awlgen_start(awlgen* g) {
+    g->stack = safe_malloc(SCHED_STACK_SIZE);
+    getcontext(&g->context);
+    g->context.uc_stack.ss_sp = g->stack;
+    g->context.uc_stack.ss_size = SCHED_STACK_SIZE;
+    g->context.uc_link = NULL;
+    makecontext(&g->context, awlgen_main, 0);
+    g->depth = awlval_eval_depth_new(SCHED_STACK_SIZE);
+}
+
+static void awlgen_finish(awlgen* g) {
+    if (g->all_prev) {
+        g->all_prev->all_next = g->all_next;
+    } else {
+        gens = g->all_next;
+    }
+    if (g->all_next) {
+        g->all_next->all_prev = g->all_prev;
+    }
+
+    /* the generator has switched off its stack for good */
+    free(g->stack);
+    g->stack = NULL;
+    awlenv_del(g->env);
+    g->env = NULL;
+}
+
+awlval* awlgen_next(awlgen* g) {
+    if (g->running) {
+        return awlval_err("generator is already running");
+    }
+    if (g->finished) {
+        return NULL;
+    }
+    if (!g->stack) {
+        awlgen_start(g);
+    }
+
+    g->running = true;
+    g->outer = current->gen;
+    current->gen = g;
+    g->caller_depth = awlval_eval_depth_swap(g->depth);
+    swapcontext(&g->caller, &g->context);
+    g->running = false;
+
+    if (g->finished) {
+        awlgen_finish(g);
+    }
+    awlval* x = g->value;
+    g->value = NULL;
+    return x;
+}
+
+bool awlgen_done(const awlgen* g) {
+    return g->finished;
+}
+
+awlval* awlgen_yield(awlval* v) {
+    awlgen* g = current->gen;
+    if (!g) {
+        awlval_del(v);
+        return awlval_err("function 'yield' was given a value outside a generator");
+    }
+    if (g->closed) {
+        awlval_del(v);
+        return awlval_err("generator closed");
+    }
+
+    awlgen_return(g, v);
+    return g->closed ? awlval_err("generator closed") : NULL;
+}
+
+/* A generator left suspended is resumed to unwind, with everything it
+ * yields or waits on from then on an error */
+void awlgen_close(awlgen* g) {
+    if (g->running) {
+        return;
+    }
+    if (!g->stack) {
+        if (!g->finished) {
+            awlval_del(g->f);
+            awlval_del(g->args);
+            g->f = NULL;
+            g->args = NULL;
+            g->finished = true;
+            awlgen_finish(g);
+        }
+        return;
+    }
+
+    g->closed = true;
+    while (!g->finished) {
+        awlval* x = awlgen_next(g);
+        if (x) {
+            awlval_del(x);
+        }
+    }
+}
+
+void awlgen_del(awlgen* g) {
+    if (--g->refs > 0) {
+        return;
+    }
+    awlgen_close(g);
+    free(g);
+}
+
+void teardown_sched(void) {
+    for (sched_task* t = tasks; t; t = t->all_next) {
+        if (t == finished) {
+            continue;
+        }
+        t->cancelled = true;
+        if (t->waiting_on) {
+            sched_unwait(t);
+            sched_push(t);
+        }
+    }
+
+    /* cancelled tasks never wait, so the last to unwind wakes this one */
+    while (live_tasks > 0 && runnable) {
+        sched_switch(sched_pop());
+    }
+    main_task.deadlocked = false;
+    sched_reap();
+
+    /* suspended generators hold on to whatever their stacks refer to, the
+     * environments that hold them included, so that only goes once each
+     * is closed */
+    if (gens) {
+        while (gens) {
+            /* closing may let go of the last reference elsewhere */
+            awlgen* g = awlgen_retain(gens);
+            awlgen_close(g);
+            awlgen_del(g);
+        }
+        gc_collect();
+    }
+
+#ifdef SIGEV_THREAD_ID
+    if (timer_created) {
+        timer_delete(timer);
+        timer_created = false;
+    }
+#endif
+}
@@ -0,0 +1,73 @@
+#ifndef AWL_SCHED_H
+#define AWL_SCHED_H
+
+#include "types.h"
+
+/* Tasks are evaluations interleaved on the one OS thread, the main
+ * evaluation among them. Each runs on a C stack of its own, so it can be
+ * suspended wherever it is and resumed later. The running task carries on
+ * until it yields, waits on an empty channel or finishes, or until its
+ * time slice is up and evaluation reaches a safe point (see
+ * awlval_eval_preempt); the next runnable task then takes over */
+#define SCHED_STACK_SIZE (2L * 1024 * 1024)
+#define SCHED_SLICE_USEC 10000
+
+struct sched_task;
+
+/* An unbounded queue of values, and the tasks waiting to receive from it
+ * in the order they started to wait */
+struct awlchan {
+    int refs;
+    awlval** vals;
+    int head;
+    int count;
+    int size;
+    struct sched_task* waiting;
+    struct sched_task* waiting_last;
+};
+
+/* makes the calling thread's evaluation its main task */
+void setup_sched(void);
+
+/* 0 or less resets the slice to SCHED_SLICE_USEC */
+void sched_set_slice(long usec);
+long sched_slice(void);
+
+awlchan* awlchan_new(void);
+awlchan* awlchan_retain(awlchan* c);
+void awlchan_del(awlchan* c);
+
+/* starts a task that applies f to the evaluated arguments in args, and
+ * returns a channel that receives what it evaluates to, error or not */
+awlval* sched_spawn(awlenv* e, awlval* f, awlval* args);
+
+/* Each of these returns an error once the running task is cancelled;
+ * sched_yield returns NULL otherwise */
+awlval* sched_yield(void);
+void sched_send(awlchan* c, awlval* v);
+/* waits until c holds a value, or no task is left to send one */
+awlval* sched_recv(awlchan* c);
+
+/* A generator is a function applied on a C stack of its own, which stops
+ * each time it yields a value and carries on from there when the next one
+ * is asked for; it runs as part of whichever task asks */
+awlgen* awlgen_new(awlenv* e, awlval* f, awlval* args);
+awlgen* awlgen_retain(awlgen* g);
+/* closes the generator once the last reference to it goes */
+void awlgen_del(awlgen* g);
+
+/* runs g until it yields, returning what it yielded, or the error it
+ * finished with; NULL once it has finished */
+awlval* awlgen_next(awlgen* g);
+bool awlgen_done(const awlgen* g);
+/* passes v to whoever resumed the running generator, and returns NULL
+ * once it is resumed again, or an error if there is none or it is closed */
+awlval* awlgen_yield(awlval* v);
+/* unwinds a suspended generator, each yield from then on an error */
+void awlgen_close(awlgen* g);
+
+/* cancels the tasks left, and runs each until it has unwound, then closes
+ * the generators left */
+void teardown_sched(void);
+
+#endif
@@ -9,9 +9,25 @@
 
 #include "assert.h"
 #include "builtins.h"
+#include "eval.h"
+#include "gc.h"
+#include "hamt.h"
+#include "intern.h"
+#include "pool.h"
 #include "print.h"
+#include "sched.h"
 #include "util.h"
 
+#define AWLVAL_CELL_MIN_CAPACITY 4
+#define AWLVAL_CELL_GROWTH_FACTOR 2
+#define AWLVAL_VIEW_MIN_COUNT 8
+#define AWLVAL_STR_VIEW_MIN_LENGTH 32
+#define AWLVAL_STR_GROWTH_FACTOR 2
+
+/* forward declaration */
+static void awlval_free_cells(awlval* v);
+static void awlval_own_cells(awlval* v);
+
 char* awlval_type_name(awlval_type_t t) {
     switch (t) {
         case AWLVAL_ERR: return "Error";
@@ -25,6 +41,8 @@ char* awlval_type_name(awlval_type_t t) {
         case AWLVAL_STR: return "String";
         case AWLVAL_BOOL: return "Boolean";
         case AWLVAL_DICT: return "Dictionary";
+        case AWLVAL_CHAN: return "Channel";
+        case AWLVAL_GEN: return "Generator";
         case AWLVAL_SEXPR: return "S-Expression";
         case AWLVAL_QEXPR: return "Q-Expression";
         case AWLVAL_EEXPR: return "E-Expression";
@@ -46,6 +64,8 @@ char* awlval_type_sysname(awlval_type_t t) {
         case AWLVAL_STR: return "str";
         case AWLVAL_BOOL: return "bool";
         case AWLVAL_DICT: return "dict";
+        case AWLVAL_CHAN: return "chan";
+        case AWLVAL_GEN: return "gen";
         case AWLVAL_SEXPR: return "sexpr";
         case AWLVAL_QEXPR: return "qexpr";
         case AWLVAL_EEXPR: return "eexpr";
@@ -80,6 +100,10 @@ awlval_type_t awlval_parse_sysname(const char* sysname) {
         return AWLVAL_SYM;
     } else if (streq(sysname, "dict")) {
         return AWLVAL_DICT;
+    } else if (streq(sysname, "chan")) {
+        return AWLVAL_CHAN;
+    } else if (streq(sysname, "gen")) {
+        return AWLVAL_GEN;
     } else if (streq(sysname, "sexpr")) {
         return AWLVAL_SEXPR;
     } else if (streq(sysname, "eexpr")) {
@@ -92,9 +116,29 @@ awlval_type_t awlval_parse_sysname(const char* sysname) {
     }
 }
 
+static awlval small_ints[AWLVAL_SMALL_INT_MAX - AWLVAL_SMALL_INT_MIN + 1];
+static awlval true_val = { .type = AWLVAL_BOOL, .refs = AWLVAL_IMMORTAL, .bln = true };
+static awlval false_val = { .type = AWLVAL_BOOL, .refs = AWLVAL_IMMORTAL, .bln = false };
+
+void setup_immediates(void) {
+    for (long x = AWLVAL_SMALL_INT_MIN; x <= AWLVAL_SMALL_INT_MAX; x++) {
+        awlval* v = &small_ints[x - AWLVAL_SMALL_INT_MIN];
+        v->type = AWLVAL_INT;
+        v->refs = AWLVAL_IMMORTAL;
+        v->lng = x;
+    }
+}
+
+static awlval* awlval_alloc(awlval_type_t t) {
+    awlval* v = pool_alloc(sizeof(awlval));
+    v->type = t;
+    v->refs = 1;
+    v->evaluated = false;
+    return v;
+}
+
 awlval* awlval_err(const char* fmt, ...) {
-    awlval* v = safe_malloc(sizeof(awlval));
-    v->type = AWLVAL_ERR;
+    awlval* v = awlval_alloc(AWLVAL_ERR);
 
     va_list va;
     va_start(va, fmt);
@@ -112,73 +156,158 @@ awlval* awlval_err(const char* fmt, ...) {
 }
 
 awlval* awlval_int(long x) {
-    awlval* v = safe_malloc(sizeof(awlval));
-    v->type = AWLVAL_INT;
+    if (x >= AWLVAL_SMALL_INT_MIN && x <= AWLVAL_SMALL_INT_MAX) {
+        return &small_ints[x - AWLVAL_SMALL_INT_MIN];
+    }
+
+    awlval* v = awlval_alloc(AWLVAL_INT);
     v->lng = x;
     return v;
 }
 
 awlval* awlval_float(double x) {
-    awlval* v = safe_malloc(sizeof(awlval));
-    v->type = AWLVAL_FLOAT;
+    awlval* v = awlval_alloc(AWLVAL_FLOAT);
     v->dbl = x;
     return v;
 }
 
-static awlval* awlval_sym_base(const char* s) {
-    awlval* v = safe_malloc(sizeof(awlval));
-    v->length = strlen(s);
-    v->sym = safe_malloc(strlen(s) + 1);
-    strcpy(v->sym, s);
+static awlval* awlval_sym_base(awlval_type_t t, const char* s) {
+    awlval* v = awlval_alloc(t);
+    v->sym = intern(s);
+    v->length = intern_length(v->sym);
     return v;
 }
 
 awlval* awlval_sym(const char* s) {
-    awlval* v = awlval_sym_base(s);
-    v->type = AWLVAL_SYM;
-    return v;
+    return awlval_sym_base(AWLVAL_SYM, s);
 }
 
 awlval* awlval_qsym(const char* s) {
-    awlval* v = awlval_sym_base(s);
-    v->type = AWLVAL_QSYM;
+    return awlval_sym_base(AWLVAL_QSYM, s);
+}
+
+static awlstr* awlstr_new(int capacity) {
+    awlstr* buf = safe_malloc(sizeof(awlstr) + capacity + 1);
+    buf->refs = 1;
+    buf->capacity = capacity;
+    buf->used = 0;
+    buf->data[0] = '\0';
+    return buf;
+}
+
+static void awlstr_del(awlstr* buf) {
+    if (--buf->refs == 0) {
+        free(buf);
+    }
+}
+
+static awlval* awlval_str_view(awlstr* buf, char* s, int length) {
+    awlval* v = awlval_alloc(AWLVAL_STR);
+    buf->refs++;
+    v->strbuf = buf;
+    v->str = s;
+    v->length = length;
+    return v;
+}
+
+/* A string of the given length whose characters are left to the caller */
+static awlval* awlval_str_uninit(int length) {
+    awlstr* buf = awlstr_new(length);
+    buf->used = length;
+    buf->data[length] = '\0';
+
+    awlval* v = awlval_str_view(buf, buf->data, length);
+    awlstr_del(buf);
     return v;
 }
 
 awlval* awlval_str(const char* s) {
-    awlval* v = safe_malloc(sizeof(awlval));
-    v->type = AWLVAL_STR;
-    v->length = strlen(s);
-    v->str = safe_malloc(v->length + 1);
-    strcpy(v->str, s);
+    return awlval_strn(s, strlen(s));
+}
+
+awlval* awlval_strn(const char* s, int length) {
+    awlval* v = awlval_str_uninit(length);
+    memcpy(v->str, s, length);
     return v;
 }
 
+const char* awlval_str_cstr(awlval* v) {
+    /* strings never contain NUL, so this only holds at the buffer's end */
+    if (v->str[v->length] == '\0') {
+        return v->str;
+    }
+
+    /* flatten the substring into a buffer of its own; the value is
+     * unchanged, so this is safe even if it is shared */
+    awlstr* buf = awlstr_new(v->length);
+    memcpy(buf->data, v->str, v->length);
+    buf->used = v->length;
+    buf->data[v->length] = '\0';
+
+    awlstr_del(v->strbuf);
+    v->strbuf = buf;
+    v->str = buf->data;
+    return v->str;
+}
+
 awlval* awlval_bool(bool b) {
-    awlval* v = safe_malloc(sizeof(awlval));
-    v->type = AWLVAL_BOOL;
-    v->bln = b;
-    return v;
+    return b ? &true_val : &false_val;
 }
 
 awlval* awlval_fun(const awlbuiltin builtin, const char* builtin_name) {
-    awlval* v = safe_malloc(sizeof(awlval));
-    v->type = AWLVAL_BUILTIN;
+    awlval* v = awlval_alloc(AWLVAL_BUILTIN);
     v->builtin = builtin;
-    v->builtin_name = safe_malloc(strlen(builtin_name) + 1);
-    strcpy(v->builtin_name, builtin_name);
+    v->builtin_name = intern(builtin_name);
     return v;
 }
 
 awlval* awlval_lambda(awlenv* closure, awlval* formals, awlval* body) {
-    awlval* v = safe_malloc(sizeof(awlval));
-    v->type = AWLVAL_FN;
-    v->env = awlenv_new();
+    awlval* v = awlval_alloc(AWLVAL_FN);
+    v->env = awlenv_new_slots(formals);
     v->env->parent = closure;
     v->env->parent->references++;
     v->formals = formals;
     v->body = body;
     v->called = false;
+    v->bound = 0;
+
+    v->variadic = false;
+    v->arity = formals->count;
+    for (int i = 0; i < formals->count; i++) {
+        if (streq(formals->cell[i]->sym, "&")) {
+            v->variadic = true;
+            v->arity = i;
+            break;
+        }
+    }
+    return v;
+}
+
+/* f with the first bound formals bound in env, which it takes over */
+awlval* awlval_applied(const awlval* f, awlenv* env, int bound) {
+    awlval* v = awlval_alloc(f->type);
+    v->env = env;
+    v->formals = awlval_retain(f->formals);
+    v->body = awlval_retain(f->body);
+    v->variadic = f->variadic;
+    v->arity = f->arity;
+    v->bound = bound;
+    v->called = false;
+    return v;
+}
+
+/* A call with nothing left to bind, which runs body in env, taking over
+ * both; special forms return one so that awlval_eval evaluates their body
+ * in place of the form, as a tail call */
+awlval* awlval_body(awlenv* env, awlval* body) {
+    awlval* v = awlval_alloc(AWLVAL_FN);
+    v->env = env;
+    v->formals = awlval_sexpr();
+    v->body = body;
+    v->variadic = false;
+    v->arity = 0;
+    v->bound = 0;
+    v->called = true;
     return v;
 }
 
@@ -188,8 +317,8 @@ awlval* awlval_macro(awlenv* closure, awlval* formals, awlval* body) {
     return v;
 }
 
-static void* awlval_copy_proxy(const void* v) {
-    return awlval_copy(v);
+static void* awlval_retain_proxy(const void* v) {
+    return awlval_retain((awlval*)v);
 }
 
 static void awlval_del_proxy(void* v) {
@@ -197,51 +326,86 @@ static void awlval_del_proxy(void* v) {
 }
 
 awlval* awlval_dict(void) {
-    awlval* v = safe_malloc(sizeof(awlval));
-    v->type = AWLVAL_DICT;
+    awlval* v = awlval_alloc(AWLVAL_DICT);
     v->count = 0;
     v->length = 0;
-    v->d = dict_new(awlval_copy_proxy, awlval_del_proxy);
+    v->map = NULL;
+    return v;
+}
+
+awlval* awlval_chan(void) {
+    awlval* v = awlval_alloc(AWLVAL_CHAN);
+    v->chan = awlchan_new();
+    return v;
+}
+
+awlval* awlval_gen(awlenv* e, awlval* f, awlval* args) {
+    awlval* v = awlval_alloc(AWLVAL_GEN);
+    v->gen = awlgen_new(e, f, args);
     return v;
 }
 
 awlval* awlval_sexpr(void) {
-    awlval* v = safe_malloc(sizeof(awlval));
-    v->type = AWLVAL_SEXPR;
+    awlval* v = awlval_alloc(AWLVAL_SEXPR);
     v->count = 0;
     v->length = 0;
     v->cell = NULL;
+    v->offset = 0;
+    v->capacity = 0;
+    v->backing = NULL;
+    v->folded = NULL;
     return v;
 }
 
 awlval* awlval_qexpr(void) {
-    awlval* v = safe_malloc(sizeof(awlval));
-    v->type = AWLVAL_QEXPR;
+    awlval* v = awlval_alloc(AWLVAL_QEXPR);
     v->count = 0;
     v->length = 0;
     v->cell = NULL;
+    v->offset = 0;
+    v->capacity = 0;
+    v->backing = NULL;
+    v->folded = NULL;
     return v;
 }
 
 awlval* awlval_eexpr(void) {
-    awlval* v = safe_malloc(sizeof(awlval));
-    v->type = AWLVAL_EEXPR;
+    awlval* v = awlval_alloc(AWLVAL_EEXPR);
     v->count = 0;
     v->length = 0;
     v->cell = NULL;
+    v->offset = 0;
+    v->capacity = 0;
+    v->backing = NULL;
+    v->folded = NULL;
     return v;
 }
 
 awlval* awlval_cexpr(void) {
-    awlval* v = safe_malloc(sizeof(awlval));
-    v->type = AWLVAL_CEXPR;
+    awlval* v = awlval_alloc(AWLVAL_CEXPR);
     v->count = 0;
     v->length = 0;
     v->cell = NULL;
+    v->offset = 0;
+    v->capacity = 0;
+    v->backing = NULL;
+    v->folded = NULL;
+    return v;
+}
+
+awlval* awlval_retain(awlval* v) {
+    if (v->refs != AWLVAL_IMMORTAL) {
+        v->refs++;
+    }
     return v;
 }
 
 void awlval_del(awlval* v) {
+    /* only the last holder actually frees the value */
+    if (v->refs == AWLVAL_IMMORTAL || --v->refs > 0) {
+        return;
+    }
+
     switch (v->type) {
         case AWLVAL_INT:
             break;
@@ -250,7 +414,7 @@ void awlval_del(awlval* v) {
             break;
 
         case AWLVAL_BUILTIN:
-            free(v->builtin_name);
+            intern_release(v->builtin_name);
             break;
 
         case AWLVAL_FN:
@@ -266,119 +430,278 @@ void awlval_del(awlval* v) {
 
         case AWLVAL_SYM:
         case AWLVAL_QSYM:
-            free(v->sym);
+            intern_release(v->sym);
             break;
 
         case AWLVAL_STR:
-            free(v->str);
+            awlstr_del(v->strbuf);
             break;
 
         case AWLVAL_BOOL:
             break;
 
         case AWLVAL_DICT:
-            dict_del(v->d);
+            hamt_del(v->map);
+            break;
+
+        case AWLVAL_CHAN:
+            awlchan_del(v->chan);
+            break;
+
+        case AWLVAL_GEN:
+            awlgen_del(v->gen);
             break;
 
         case AWLVAL_EEXPR:
         case AWLVAL_SEXPR:
         case AWLVAL_QEXPR:
         case AWLVAL_CEXPR:
+            if (v->folded) {
+                awlval_del(v->folded);
+            }
+            if (v->backing) {
+                awlval_del(v->backing);
+                break;
+            }
             for (int i = 0; i < v->count; i++) {
                 awlval_del(v->cell[i]);
             }
-            free(v->cell);
+            awlval_free_cells(v);
             break;
     }
 
-    free(v);
+    pool_free(v, sizeof(awlval));
+}
+
+awlval* awlval_unshare(awlval* v) {
+    /* values may only be mutated in place by their sole holder */
+    if (v->refs == 1) {
+        awlval_own_cells(v);
+        return v;
+    }
+    awlval* x = awlval_copy(v);
+    awlval_del(v);
+    return x;
+}
+
+static void awlval_free_cells(awlval* v) {
+    pool_free(v->cell - v->offset, sizeof(awlval*) * v->capacity);
+}
+
+/* Give a view its own copy of the cells it borrows */
+static void awlval_own_cells(awlval* v) {
+    if (!ISEXPR(v->type) || !v->backing) {
+        return;
+    }
+
+    awlval** cells = pool_alloc(sizeof(awlval*) * v->count);
+    for (int i = 0; i < v->count; i++) {
+        cells[i] = awlval_retain(v->cell[i]);
+    }
+    awlval_del(v->backing);
+
+    v->backing = NULL;
+    v->cell = cells;
+    v->offset = 0;
+    v->capacity = v->count;
+}
+
+/* Move the cells to a fresh array with room for front more cells before
+ * them and at least back more after them */
+static void awlval_grow_cells(awlval* v, int front, int back) {
+    int capacity = v->capacity * AWLVAL_CELL_GROWTH_FACTOR;
+    if (capacity < AWLVAL_CELL_MIN_CAPACITY) {
+        capacity = AWLVAL_CELL_MIN_CAPACITY;
+    }
+    if (capacity < front + v->count + back) {
+        capacity = front + v->count + back;
+    }
+
+    awlval** cells = pool_alloc(sizeof(awlval*) * capacity);
+    if (v->count) {
+        memcpy(cells + front, v->cell, sizeof(awlval*) * v->count);
+    }
+    awlval_free_cells(v);
+
+    v->cell = cells + front;
+    v->offset = front;
+    v->capacity = capacity;
+}
+
+/* Ensure there is room for count cells from the current start */
+static void awlval_reserve_cells(awlval* v, int count) {
+    awlval_own_cells(v);
+    if (v->offset + count <= v->capacity) {
+        return;
+    }
+
+    /* reclaim space freed at the front once it makes up half the array */
+    if (v->offset >= v->count && count <= v->capacity) {
+        memmove(v->cell - v->offset, v->cell, sizeof(awlval*) * v->count);
+        v->cell -= v->offset;
+        v->offset = 0;
+        return;
+    }
+
+    awlval_grow_cells(v, 0, count - v->count);
 }
 
 awlval* awlval_add(awlval* v, awlval* x) {
+    awlval_reserve_cells(v, v->count + 1);
+    v->cell[v->count] = x;
     v->count++;
     v->length++;
-    v->cell = realloc(v->cell, sizeof(awlval*) * v->count);
-    v->cell[v->count - 1] = x;
     return v;
 }
 
 awlval* awlval_add_front(awlval* v, awlval* x) {
-    v->count++;
-    v->length++;
-    v->cell = realloc(v->cell, sizeof(awlval*) * v->count);
-    if (v->count > 1) {
-        memmove(&v->cell[1], &v->cell[0], sizeof(awlval*) * (v->count - 1));
+    awlval_own_cells(v);
+    if (v->offset == 0) {
+        /* leave as much room at the front as there is in use */
+        int front = v->count > 1 ? v->count : 1;
+        awlval_grow_cells(v, front, 0);
     }
+    v->cell--;
+    v->offset--;
     v->cell[0] = x;
+    v->count++;
+    v->length++;
     return v;
 }
 
 awlval* awlval_add_dict(awlval* x, awlval* k, awlval* v) {
-    dict_put(x->d, k->sym, v);
-    x->count = x->length = dict_count(x->d);
+    bool added;
+    hamt_node* map = hamt_put(x->map, k->sym, v, &added);
+    hamt_del(x->map);
+    x->map = map;
+    if (added) {
+        x->count++;
+        x->length++;
+    }
     return x;
 }
 
 awlval* awlval_get_dict(awlval* x, awlval* k) {
-    return dict_get(x->d, k->sym);
+    awlval* v = hamt_get(x->map, k->sym);
+    return v ? awlval_retain(v) : NULL;
 }
 
 awlval* awlval_rm_dict(awlval* x, awlval* k) {
-    dict_rm(x->d, k->sym);
-    x->count = x->length = dict_count(x->d);
+    bool removed;
+    hamt_node* map = hamt_rm(x->map, k->sym, &removed);
+    hamt_del(x->map);
+    x->map = map;
+    if (removed) {
+        x->count--;
+        x->length--;
+    }
     return x;
 }
 
 bool awlval_haskey_dict(awlval* x, awlval* k) {
-    return dict_index(x->d, k->sym) != -1;
+    return hamt_get(x->map, k->sym) != NULL;
 }
 
-awlval* awlval_keys_dict(awlval* x) {
-    int count = dict_count(x->d);
-    char** keys = dict_all_keys(x->d);
+static void awlval_add_key(char* k, awlval* v, void* data) {
+    awlval_add(data, awlval_qsym(k));
+}
 
-    awlval* v = awlval_qexpr();
-    for (int i = 0; i < count; i++) {
-        awlval_add(v, awlval_qsym(keys[i]));
-    }
+static void awlval_add_val(char* k, awlval* v, void* data) {
+    awlval_add(data, awlval_retain(v));
+}
 
-    free(keys);
+awlval* awlval_keys_dict(awlval* x) {
+    awlval* v = awlval_qexpr();
+    hamt_foreach(x->map, awlval_add_key, v);
     return v;
 }
 
 awlval* awlval_vals_dict(awlval* x) {
-    int count = dict_count(x->d);
-    awlval** vals = (awlval**)dict_all_vals(x->d);
-
     awlval* v = awlval_qexpr();
-    for (int i = 0; i < count; i++) {
-        awlval_add(v, awlval_copy(vals[i]));
-    }
-
-    free(vals);
+    hamt_foreach(x->map, awlval_add_val, v);
     return v;
 }
 
 awlval* awlval_pop(awlval* v, int i) {
+    /* views can give up either end without touching their backing */
+    if (ISEXPR(v->type) && v->backing && (i == 0 || i == v->count - 1)) {
+        awlval* x = awlval_retain(v->cell[i]);
+        if (i == 0) {
+            v->cell++;
+        }
+        v->count--;
+        v->length--;
+        return x;
+    }
+    awlval_own_cells(v);
+
     awlval* x = v->cell[i];
 
-    memmove(&v->cell[i], &v->cell[i + 1], sizeof(awlval*) * (v->count - i - 1));
+    /* close the gap from whichever end is nearer */
+    if (i < v->count / 2) {
+        memmove(&v->cell[1], &v->cell[0], sizeof(awlval*) * i);
+        v->cell++;
+        v->offset++;
+    } else {
+        memmove(&v->cell[i], &v->cell[i + 1], sizeof(awlval*) * (v->count - i - 1));
+    }
     v->count--;
     v->length--;
 
-    v->cell = realloc(v->cell, sizeof(awlval*) * v->count);
+    if (v->count == 0) {
+        v->cell -= v->offset;
+        v->offset = 0;
+    }
+
     return x;
 }
 
 awlval* awlval_take(awlval* v, int i) {
+    /* a shared container must stay intact for its other holders */
+    if (v->refs != 1) {
+        awlval* x = awlval_retain(v->cell[i]);
+        awlval_del(v);
+        return x;
+    }
     awlval* x = awlval_pop(v, i);
     awlval_del(v);
     return x;
 }
 
+static awlval* awlval_join_str(awlval* x, awlval* y) {
+    /* Append in place when x ends where its buffer does and there is room;
+     * otherwise move to a buffer with room to spare, so that building a
+     * string by repeated appends is amortized linear */
+    awlstr* buf = x->strbuf;
+    int length = x->length + y->length;
+    if (x->str + x->length != buf->data + buf->used
+            || (x->str - buf->data) + length > buf->capacity) {
+        awlstr* grown = awlstr_new(length * AWLVAL_STR_GROWTH_FACTOR);
+        memcpy(grown->data, x->str, x->length);
+        grown->used = x->length;
+
+        awlstr_del(buf);
+        buf = x->strbuf = grown;
+        x->str = grown->data;
+    }
+
+    memcpy(buf->data + buf->used, y->str, y->length);
+    buf->used += y->length;
+    buf->data[buf->used] = '\0';
+    x->length = length;
+
+    awlval_del(y);
+    return x;
+}
+
 awlval* awlval_join(awlval* x, awlval* y) {
-    while (y->count) {
-        x = awlval_add(x, awlval_pop(y, 0));
+    if (x->type == AWLVAL_STR) {
+        return awlval_join_str(x, y);
+    }
+
+    awlval_reserve_cells(x, x->count + y->count);
+    for (int i = 0; i < y->count; i++) {
+        x = awlval_add(x, awlval_retain(y->cell[i]));
     }
 
     awlval_del(y);
@@ -386,19 +709,27 @@ awlval* awlval_join(awlval* x, awlval* y) {
 }
 
 awlval* awlval_insert(awlval* x, awlval* y, int i) {
-    x->count++;
-    x->length++;
-    x->cell = realloc(x->cell, sizeof(awlval*) * x->count);
+    if (i == 0) {
+        return awlval_add_front(x, y);
+    }
 
-    memmove(&x->cell[i + 1], &x->cell[i], sizeof(awlval*) * (x->count - i - 1));
+    awlval_reserve_cells(x, x->count + 1);
+    memmove(&x->cell[i + 1], &x->cell[i], sizeof(awlval*) * (x->count - i));
     x->cell[i] = y;
+    x->count++;
+    x->length++;
     return x;
 }
 
 awlval* awlval_shift(awlval* x, awlval* y, int i) {
-    while (y->count) {
-        x = awlval_insert(x, awlval_pop(y, y->count - 1), i);
+    /* open a gap for all of y at once rather than inserting one by one */
+    awlval_reserve_cells(x, x->count + y->count);
+    memmove(&x->cell[i + y->count], &x->cell[i], sizeof(awlval*) * (x->count - i));
+    for (int j = 0; j < y->count; j++) {
+        x->cell[i + j] = awlval_retain(y->cell[j]);
     }
+    x->count += y->count;
+    x->length += y->count;
 
     awlval_del(y);
     return x;
@@ -406,75 +737,104 @@ awlval* awlval_shift(awlval* x, awlval* y, int i) {
 
 static awlval* awlval_reverse_qexpr(awlval* x) {
     awlval* y = awlval_qexpr();
-    while (x->count) {
-        y = awlval_add(y, awlval_pop(x, x->count - 1));
+    for (int i = x->count - 1; i >= 0; i--) {
+        y = awlval_add(y, awlval_retain(x->cell[i]));
     }
     awlval_del(x);
     return y;
 }
 
 static awlval* awlval_reverse_qsym(awlval* x) {
+    /* interned names are never modified; build a new symbol instead */
     char* reversed = strrev(x->sym);
-    free(x->sym);
-    x->sym = reversed;
-    return x;
+    awlval* y = awlval_qsym(reversed);
+    free(reversed);
+    awlval_del(x);
+    return y;
 }
 
 static awlval* awlval_reverse_str(awlval* x) {
-    char* reversed = strrev(x->str);
-    free(x->str);
-    x->str = reversed;
-    return x;
+    awlval* y = awlval_str_uninit(x->length);
+    for (int i = 0; i < x->length; i++) {
+        y->str[i] = x->str[x->length - 1 - i];
+    }
+    awlval_del(x);
+    return y;
 }
 
 awlval* awlval_reverse(awlval* x) {
     if (x->type == AWLVAL_QEXPR) {
         return awlval_reverse_qexpr(x);
-    } else if (x->type == AWLVAL_STR) {
+    }
+
+    if (x->type == AWLVAL_STR) {
         return awlval_reverse_str(x);
     } else {
         return awlval_reverse_qsym(x);
     }
 }
 
+static awlval* awlval_view(awlval* x, int start, int end) {
+    awlval* y = awlval_qexpr();
+    y->backing = awlval_retain(x->backing ? x->backing : x);
+    y->folded = NULL;
+    y->cell = x->cell + start;
+    y->count = y->length = end - start;
+    awlval_del(x);
+    return y;
+}
+
 static awlval* awlval_slice_step_qexpr(awlval* x, int start, int end, int step) {
-    /* Remove from front */
-    while (start) {
-        awlval_del(awlval_pop(x, 0));
-        start--; end--;
-    }
-    /* Remove from back */
-    while (end < x->count) {
-        awlval_del(awlval_pop(x, end));
-    }
-    /* Remove by steps */
-    if (step > 1 && x->count) {
-        int final_count = x->count / step + (x->count % step == 0 ? 0 : 1),
-            multiplier = 0,
-            removal_offset = 0;
-
-        while (x->count > final_count) {
-            for (int i = 1; i < step; i++) {
-                int idx = multiplier * step + i - removal_offset;
-                awlval_del(awlval_pop(x, idx));
-                removal_offset++;
-            }
-            multiplier++;
+    /* Contiguous slices covering most of the source borrow its cells, so
+     * that walking a list by repeated tails is linear. Small slices are
+     * copied rather than keeping a large source alive */
+    if (step == 1 && end - start >= AWLVAL_VIEW_MIN_COUNT && (end - start) * 2 >= x->count) {
+        if (x->refs != 1) {
+            return awlval_view(x, start, end);
+        }
+
+        /* a sole holder can simply trim the source in place */
+        while (x->count > end) {
+            awlval_del(awlval_pop(x, x->count - 1));
+        }
+        for (int i = 0; i < start; i++) {
+            awlval_del(awlval_pop(x, 0));
         }
+        return x;
     }
-    return x;
+
+    /* Collect the selected cells, leaving the source untouched */
+    awlval* y = awlval_qexpr();
+    for (int i = start; i < end; i += step) {
+        y = awlval_add(y, awlval_retain(x->cell[i]));
+    }
+    awlval_del(x);
+    return y;
 }
 
 static awlval* awlval_slice_step_str(awlval* x, int start, int end, int step) {
-    char* sliced = strsubstr(x->str, start, end);
-    if (step > 1 && strlen(sliced)) {
-        char* stepped = strstep(sliced, step);
-        free(sliced);
-        sliced = stepped;
+    if (step == 1) {
+        /* a sole holder narrows itself; otherwise substrings long enough to
+         * be worth it share the characters of the source */
+        if (x->refs == 1) {
+            x->str += start;
+            x->length = end - start;
+            return x;
+        }
+        if (end - start >= AWLVAL_STR_VIEW_MIN_LENGTH) {
+            awlval* y = awlval_str_view(x->strbuf, x->str + start, end - start);
+            awlval_del(x);
+            return y;
+        }
     }
-    free(x->str);
-    x->str = sliced;
-    return x;
+
+    int length = end > start ? (end - start + step - 1) / step : 0;
+    awlval* y = awlval_str_uninit(length);
+    for (int i = 0; i < length; i++) {
+        y->str[i] = x->str[start + i * step];
+    }
+    awlval_del(x);
+    return y;
 }
 
 static awlval* awlval_slice_step_qsym(awlval* x, int start, int end, int step) {
@@ -484,15 +844,18 @@ static awlval* awlval_slice_step_qsym(awlval* x, int start, int end, int step) {
         free(sliced);
         sliced = stepped;
     }
-    free(x->sym);
-    x->sym = sliced;
-    return x;
+    awlval* y = awlval_qsym(sliced);
+    free(sliced);
+    awlval_del(x);
+    return y;
 }
 
 awlval* awlval_slice_step(awlval* x, int start, int end, int step) {
     if (x->type == AWLVAL_QEXPR) {
         return awlval_slice_step_qexpr(x, start, end, step);
-    } else if (x->type == AWLVAL_STR) {
+    }
+
+    if (x->type == AWLVAL_STR) {
         return awlval_slice_step_str(x, start, end, step);
     } else {
         return awlval_slice_step_qsym(x, start, end, step);
@@ -503,47 +866,25 @@ awlval* awlval_slice(awlval* x, int start, int end) {
     return awlval_slice_step(x, start, end, 1);
 }
 
-void awlval_maybe_promote_numeric(awlval* a, awlval* b) {
-    if (!(ISNUMERIC(a->type) && ISNUMERIC(b->type))) {
-        return;
-    }
-    if (a->type == AWLVAL_FLOAT || b->type == AWLVAL_FLOAT) {
-        awlval_promote_numeric(a);
-        awlval_promote_numeric(b);
-    }
-}
-
-void awlval_promote_numeric(awlval* x) {
-    if (x->type != AWLVAL_FLOAT) {
-        x->type = AWLVAL_FLOAT;
-        x->dbl = (double)x->lng;
-    }
-}
-
-void awlval_demote_numeric(awlval* x) {
-    if (x->type != AWLVAL_INT) {
-        x->type = AWLVAL_INT;
-        x->lng = (long)x->dbl;
-    }
-}
-
 awlval* awlval_copy(const awlval* v) {
-    awlval* x = safe_malloc(sizeof(awlval));
-    x->type = v->type;
+    /* Copies only the outermost value; children are shared */
+    awlval* x = awlval_alloc(v->type);
 
     switch (v->type) {
         case AWLVAL_BUILTIN:
             x->builtin = v->builtin;
-            x->builtin_name = safe_malloc(strlen(v->builtin_name) + 1);
-            strcpy(x->builtin_name, v->builtin_name);
+            x->builtin_name = intern_retain(v->builtin_name);
             break;
 
         case AWLVAL_FN:
         case AWLVAL_MACRO:
             x->env = awlenv_copy(v->env);
-            x->formals = awlval_copy(v->formals);
-            x->body = awlval_copy(v->body);
+            x->formals = awlval_retain(v->formals);
+            x->body = awlval_retain(v->body);
             x->called = v->called;
+            x->variadic = v->variadic;
+            x->arity = v->arity;
+            x->bound = v->bound;
             break;
 
         case AWLVAL_INT:
@@ -562,14 +903,14 @@ awlval* awlval_copy(const awlval* v) {
         case AWLVAL_SYM:
         case AWLVAL_QSYM:
             x->length = v->length;
-            x->sym = safe_malloc(strlen(v->sym) + 1);
-            strcpy(x->sym, v->sym);
+            x->sym = intern_retain(v->sym);
             break;
 
         case AWLVAL_STR:
             x->length = v->length;
-            x->str = safe_malloc(strlen(v->str) + 1);
-            strcpy(x->str, v->str);
+            x->str = v->str;
+            x->strbuf = v->strbuf;
+            x->strbuf->refs++;
             break;
 
         case AWLVAL_BOOL:
@@ -579,7 +920,15 @@ awlval* awlval_copy(const awlval* v) {
         case AWLVAL_DICT:
             x->count = v->count;
             x->length = v->length;
-            x->d = dict_copy(v->d);
+            x->map = hamt_retain(v->map);
+            break;
+
+        case AWLVAL_CHAN:
+            x->chan = awlchan_retain(v->chan);
+            break;
+
+        case AWLVAL_GEN:
+            x->gen = awlgen_retain(v->gen);
             break;
 
         case AWLVAL_SEXPR:
@@ -588,9 +937,13 @@ awlval* awlval_copy(const awlval* v) {
         case AWLVAL_CEXPR:
             x->count = v->count;
             x->length = v->length;
-            x->cell = safe_malloc(sizeof(awlval*) * x->count);
+            x->cell = pool_alloc(sizeof(awlval*) * x->count);
+            x->offset = 0;
+            x->capacity = x->count;
+            x->backing = NULL;
+            x->folded = NULL;
             for (int i = 0; i < x->count; i++) {
-                x->cell[i] = awlval_copy(v->cell[i]);
+                x->cell[i] = awlval_retain(v->cell[i]);
             }
             break;
     }
@@ -598,9 +951,9 @@ awlval* awlval_copy(const awlval* v) {
     return x;
 }
 
-awlval* awlval_convert(awlval_type_t t, const awlval* v) {
+awlval* awlval_convert(awlval_type_t t, awlval* v) {
     if (v->type == t) {
-        return awlval_copy(v);
+        return awlval_retain(v);
     }
 
     switch (t) {
@@ -613,9 +966,10 @@ awlval* awlval_convert(awlval_type_t t, const awlval* v) {
                 case AWLVAL_STR:
                     {
                         errno = 0;
-                        char* strend = v->str;
-                        long x = strtol(v->str, &strend, 10);
-                        return errno != ERANGE && *strend == '\0' ? awlval_int(x) : awlval_err("invalid number: %s", v->str);
+                        const char* s = awlval_str_cstr(v);
+                        char* strend;
+                        long x = strtol(s, &strend, 10);
+                        return errno != ERANGE && *strend == '\0' ? awlval_int(x) : awlval_err("invalid number: %s", s);
                     }
                     break;
 
@@ -639,9 +993,10 @@ awlval* awlval_convert(awlval_type_t t, const awlval* v) {
                 case AWLVAL_STR:
                     {
                         errno = 0;
-                        char* strend = v->str;
-                        double x = strtod(v->str, &strend);
-                        return errno != ERANGE && *strend == '\0' ? awlval_float(x) : awlval_err("invalid float: %s", v->str);
+                        const char* s = awlval_str_cstr(v);
+                        char* strend;
+                        double x = strtod(s, &strend);
+                        return errno != ERANGE && *strend == '\0' ? awlval_float(x) : awlval_err("invalid float: %s", s);
                     }
                     break;
 
@@ -687,7 +1042,7 @@ awlval* awlval_convert(awlval_type_t t, const awlval* v) {
         case AWLVAL_QSYM:
             switch (v->type) {
                 case AWLVAL_STR:
-                    return awlval_qsym(v->str);
+                    return awlval_qsym(awlval_str_cstr(v));
                     break;
 
                 default:
@@ -703,8 +1058,35 @@ awlval* awlval_convert(awlval_type_t t, const awlval* v) {
     }
 }
 
+typedef struct {
+    awlval* other;
+    bool equal;
+} awlval_dict_eq_t;
+
+static void awlval_dict_eq_entry(char* k, awlval* v, void* data) {
+    awlval_dict_eq_t* state = data;
+    if (state->equal) {
+        awlval* w = hamt_get(state->other->map, k);
+        state->equal = w && awlval_eq(v, w);
+    }
+}
+
+static bool awlval_dict_eq(awlval* x, awlval* y) {
+    if (x->count != y->count) {
+        return false;
+    }
+    awlval_dict_eq_t state = { y, true };
+    hamt_foreach(x->map, awlval_dict_eq_entry, &state);
+    return state.equal;
+}
+
 bool awlval_eq(awlval* x, awlval* y) {
-    awlval_maybe_promote_numeric(x, y);
+    /* Compare mixed numerics by value, without promoting shared operands */
+    if (ISNUMERIC(x->type) && ISNUMERIC(y->type) && x->type != y->type) {
+        double a = x->type == AWLVAL_FLOAT ? x->dbl : (double)x->lng;
+        double b = y->type == AWLVAL_FLOAT ? y->dbl : (double)y->lng;
+        return a == b;
+    }
     if (x->type != y->type) {
         return false;
     }
@@ -716,7 +1098,8 @@ bool awlval_eq(awlval* x, awlval* y) {
 
         case AWLVAL_FN:
         case AWLVAL_MACRO:
-            return y->type == x->type && awlval_eq(x->formals, y->formals) && awlval_eq(x->body, y->body);
+            return y->type == x->type && x->bound == y->bound
+                && awlval_eq(x->formals, y->formals) && awlval_eq(x->body, y->body);
             break;
 
         case AWLVAL_INT:
@@ -733,11 +1116,11 @@ bool awlval_eq(awlval* x, awlval* y) {
 
         case AWLVAL_SYM:
         case AWLVAL_QSYM:
-            return x->length == y->length && streq(x->sym, y->sym);
+            return x->sym == y->sym;
             break;
 
         case AWLVAL_STR:
-            return x->length == y->length && streq(x->str, y->str);
+            return x->length == y->length && memcmp(x->str, y->str, x->length) == 0;
             break;
 
         case AWLVAL_BOOL:
@@ -745,7 +1128,15 @@ bool awlval_eq(awlval* x, awlval* y) {
             break;
 
         case AWLVAL_DICT:
-            return dict_equal(x->d, y->d);
+            return awlval_dict_eq(x, y);
+            break;
+
+        case AWLVAL_CHAN:
+            return x->chan == y->chan;
+            break;
+
+        case AWLVAL_GEN:
+            return x->gen == y->gen;
             break;
 
         case AWLVAL_SEXPR:
@@ -770,12 +1161,53 @@ bool is_awlval_empty_qexpr(awlval* x) {
     return x->type == AWLVAL_QEXPR && x->count == 0;
 }
 
+static _Thread_local unsigned long version = 1;
+
+unsigned long awlenv_version(void) {
+    return version;
+}
+
+static _Thread_local unsigned long serial = 0;
+static _Thread_local unsigned long frozen = 0;
+
+unsigned long awlenv_freeze(void) {
+    unsigned long mark = frozen;
+    frozen = serial + 1;
+    return mark;
+}
+
+void awlenv_thaw(unsigned long mark) {
+    frozen = mark;
+}
+
+bool awlenv_frozen(const awlenv* e, bool global) {
+    while (global && e->parent) {
+        e = e->parent;
+    }
+    return e->serial < frozen;
+}
+
 awlenv* awlenv_new(void) {
-    awlenv* e = safe_malloc(sizeof(awlenv));
+    awlenv* e = pool_alloc(sizeof(awlenv));
     e->parent = NULL;
-    e->internal_dict = dict_new(awlval_copy_proxy, awlval_del_proxy);
+    e->slot_names = NULL;
+    e->slots = NULL;
+    e->internal_dict = NULL;
     e->top_level = false;
+    e->cache_key = false;
     e->references = 1;
+    e->serial = ++serial;
+    gc_track_env(e);
+    return e;
+}
+
+awlenv* awlenv_new_slots(awlval* names) {
+    awlenv* e = awlenv_new();
+    e->slot_names = awlval_retain(names);
+    e->slots = pool_alloc(sizeof(awlval*) * names->count);
+    for (int i = 0; i < names->count; i++) {
+        e->slots[i] = NULL;
+    }
     return e;
 }
 
@@ -787,33 +1219,103 @@ awlenv* awlenv_new_top_level(void) {
     return e;
 }
 
+static void awlenv_del_slots(awlenv* e) {
+    for (int i = 0; i < e->slot_names->count; i++) {
+        if (e->slots[i]) {
+            awlval_del(e->slots[i]);
+            e->slots[i] = NULL;
+        }
+    }
+}
+
 void awlenv_del(awlenv* e) {
     e->references--;
 
     if (e->references <= 0 && !e->top_level) {
-        if (e->parent && e->parent->references >= 1) {
+        if (e->parent) {
             awlenv_del(e->parent);
         }
 
-        dict_del(e->internal_dict);
-        free(e);
+        if (e->cache_key) {
+            version++;
+        }
+
+        gc_untrack_env(e);
+        if (e->slot_names) {
+            awlenv_del_slots(e);
+            pool_free(e->slots, sizeof(awlval*) * e->slot_names->count);
+            awlval_del(e->slot_names);
+        }
+        if (e->internal_dict) {
+            dict_del(e->internal_dict);
+        }
+        pool_free(e, sizeof(awlenv));
     }
 }
 
 void awlenv_del_top_level(awlenv* e) {
-    e->references = 1;
+    /* closures defined at the top level refer back to it, so whatever is
+     * left once the owner lets go is a cycle for the collector, as are
+     * the macros it defined if their expansions are let go too */
     e->top_level = false;
     awlenv_del(e);
+    awlval_expansions_clear();
+    gc_collect();
 }
 
+void awlenv_clear(awlenv* e) {
+    if (e->cache_key) {
+        version++;
+    }
+
+    if (e->slot_names) {
+        awlenv_del_slots(e);
+    }
+
+    dict* d = e->internal_dict;
+    e->internal_dict = NULL;
+    if (d) {
+        dict_del(d);
+    }
+
+    if (e->parent) {
+        awlenv* parent = e->parent;
+        e->parent = NULL;
+        awlenv_del(parent);
+    }
+}
+
+static int awlenv_slot(const awlenv* e, const char* k) {
+    if (e->slot_names) {
+        for (int i = 0; i < e->slot_names->count; i++) {
+            if (e->slot_names->cell[i]->sym == k) {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+/* -1 if k is not bound in e itself */
 int awlenv_index(awlenv* e, awlval* k) {
-    return dict_index(e->internal_dict, k->sym);
+    int i = awlenv_slot(e, k->sym);
+    if (i != -1 && e->slots[i]) {
+        return i;
+    }
+    return e->internal_dict ? dict_index(e->internal_dict, k->sym) : -1;
 }
 
 static awlval* awlenv_lookup(awlenv* e, char* k) {
-    int i = dict_index(e->internal_dict, k);
-    if (i != -1) {
-        return dict_get_at(e->internal_dict, i);
+    int i = awlenv_slot(e, k);
+    if (i != -1 && e->slots[i]) {
+        return awlval_retain(e->slots[i]);
+    }
+
+    if (e->internal_dict) {
+        i = dict_index(e->internal_dict, k);
+        if (i != -1) {
+            return dict_get_at(e->internal_dict, i);
+        }
     }
 
     /* check parent if not found */
@@ -828,8 +1330,84 @@ awlval* awlenv_get(awlenv* e, awlval* k) {
     return awlenv_lookup(e, k->sym);
 }
 
+/* Look k up in the slot the compiler resolved it to, depth frames out.
+ * Names bound in between since (by 'define') shadow it, in which case,
+ * as for a slot not yet bound, it is looked up by name instead */
+awlval* awlenv_get_at(awlenv* e, int depth, int slot, awlval* k) {
+    awlenv* x = e;
+    for (int i = 0; i < depth; i++) {
+        if (x->internal_dict && dict_index(x->internal_dict, k->sym) != -1) {
+            return awlenv_get(e, k);
+        }
+        x = x->parent;
+    }
+
+    if (x->slots[slot]) {
+        return awlval_retain(x->slots[slot]);
+    }
+    return awlenv_get(e, k);
+}
+
+/* Slots are bound as calls are made without bumping the version, so no
+ * binding found past a frame with a slot named k can be cached, nor can
+ * one found before outer, in a frame only the current call can see */
+awlval* awlenv_get_cached(awlenv* e, awlval* k, awlenv* outer, bool* cacheable) {
+    *cacheable = true;
+    bool passed = false;
+    for (awlenv* x = e; x; x = x->parent) {
+        passed = passed || x == outer;
+
+        int i = awlenv_slot(x, k->sym);
+        if (i != -1) {
+            *cacheable = false;
+            if (x->slots[i]) {
+                return awlval_retain(x->slots[i]);
+            }
+        }
+
+        if (x->internal_dict) {
+            i = dict_index(x->internal_dict, k->sym);
+            if (i != -1) {
+                *cacheable = *cacheable && passed;
+                return dict_get_at(x->internal_dict, i);
+            }
+        }
+    }
+
+    *cacheable = false;
+    return awlval_err("unbound symbol '%s'", k->sym);
+}
+
+/* Frames share their bindings with the frame they were copied from until
+ * one of them binds something */
+static void awlenv_own_dict(awlenv* e) {
+    if (!e->internal_dict) {
+        e->internal_dict = dict_new(awlval_retain_proxy, awlval_del_proxy);
+    } else if (e->internal_dict->refs > 1) {
+        dict* d = dict_copy(e->internal_dict);
+        dict_del(e->internal_dict);
+        e->internal_dict = d;
+    }
+}
+
 void awlenv_put(awlenv* e, awlval* k, awlval* v) {
+    int i = awlenv_slot(e, k->sym);
+    if (i != -1) {
+        awlenv_put_slot(e, i, v);
+        return;
+    }
+
+    awlenv_own_dict(e);
     dict_put(e->internal_dict, k->sym, v);
+    version++;
+}
+
+void awlenv_put_slot(awlenv* e, int slot, awlval* v) {
+    awlval_retain(v);
+    if (e->slots[slot]) {
+        awlval_del(e->slots[slot]);
+    }
+    e->slots[slot] = v;
 }
 
 void awlenv_put_global(awlenv* e, awlval* k, awlval* v) {
@@ -840,14 +1418,29 @@ void awlenv_put_global(awlenv* e, awlval* k, awlval* v) {
 }
 
 awlenv* awlenv_copy(awlenv* e) {
-    awlenv* n = safe_malloc(sizeof(awlenv));
+    awlenv* n = pool_alloc(sizeof(awlenv));
     n->parent = e->parent;
     if (n->parent) {
         n->parent->references++;
     }
-    n->internal_dict = dict_copy(e->internal_dict);
+
+    /* slots are few, so they are copied rather than shared */
+    n->slot_names = NULL;
+    n->slots = NULL;
+    if (e->slot_names) {
+        n->slot_names = awlval_retain(e->slot_names);
+        n->slots = pool_alloc(sizeof(awlval*) * e->slot_names->count);
+        for (int i = 0; i < e->slot_names->count; i++) {
+            n->slots[i] = e->slots[i] ? awlval_retain(e->slots[i]) : NULL;
+        }
+    }
+
+    n->internal_dict = e->internal_dict ? dict_retain(e->internal_dict) : NULL;
     n->top_level = e->top_level;
+    n->cache_key = false;
     n->references = 1;
+    n->serial = ++serial;
+    gc_track_env(n);
 
     return n;
 }
@@ -902,7 +1495,22 @@ void awlenv_add_builtins(awlenv* e) {
     awlenv_add_builtin(e, "reverse", builtin_reverse);
     awlenv_add_builtin(e, "slice", builtin_slice);
 
+    awlenv_add_builtin(e, "reduce", builtin_reduce);
+    awlenv_add_builtin(e, "map", builtin_map);
+    awlenv_add_builtin(e, "filter", builtin_filter);
+    awlenv_add_builtin(e, "pmap", builtin_pmap);
+    awlenv_add_builtin(e, "pfilter", builtin_pfilter);
+    awlenv_add_builtin(e, "preduce", builtin_preduce);
+    awlenv_add_builtin(e, "any", builtin_any);
+    awlenv_add_builtin(e, "all", builtin_all);
+    awlenv_add_builtin(e, "sum", builtin_sum);
+    awlenv_add_builtin(e, "product", builtin_product);
+    awlenv_add_builtin(e, "zip", builtin_zip);
+    awlenv_add_builtin(e, "member?", builtin_member);
+    awlenv_add_builtin(e, "range", builtin_range);
+
     awlenv_add_builtin(e, "if", builtin_if);
+    awlenv_add_builtin(e, "do", builtin_do);
     awlenv_add_builtin(e, "define", builtin_define);
     awlenv_add_builtin(e, "global", builtin_global);
 
@@ -917,7 +1525,19 @@ void awlenv_add_builtins(awlenv* e) {
     awlenv_add_builtin(e, "println", builtin_println);
     awlenv_add_builtin(e, "random", builtin_random);
     awlenv_add_builtin(e, "error", builtin_error);
+    awlenv_add_builtin(e, "gc", builtin_gc);
+    awlenv_add_builtin(e, "gc-stats", builtin_gcstats);
     awlenv_add_builtin(e, "exit", builtin_exit);
+
+    awlenv_add_builtin(e, "spawn", builtin_spawn);
+    awlenv_add_builtin(e, "yield", builtin_yield);
+    awlenv_add_builtin(e, "chan", builtin_chan);
+    awlenv_add_builtin(e, "send", builtin_send);
+    awlenv_add_builtin(e, "recv", builtin_recv);
+    awlenv_add_builtin(e, "generator", builtin_generator);
+    awlenv_add_builtin(e, "next", builtin_next);
+    awlenv_add_builtin(e, "done?", builtin_done);
+    awlenv_add_builtin(e, "gen-take", builtin_gentake);
 }
 
 void awlenv_add_core_lib(awlenv* e) {
@@ -2,13 +2,28 @@
 #define AWL_TYPES_H
 
 #include <stdbool.h>
+#include <limits.h>
 
 #include "dict.h"
 
 struct awlval;
 struct awlenv;
+struct hamt_node;
 typedef struct awlval awlval;
 typedef struct awlenv awlenv;
+typedef struct hamt_node hamt_node;
+typedef struct awlchan awlchan;
+typedef struct awlgen awlgen;
+
+/* Characters of a string, shared between the string and any copies and
+ * substrings taken from it. Only the string ending exactly at used may
+ * append in place; data[used] is always NUL */
+typedef struct {
+    int refs;
+    int capacity;
+    int used;
+    char data[];
+} awlstr;
 
 /* awlval types */
 typedef enum {
@@ -25,6 +40,8 @@ typedef enum {
     AWLVAL_FN,
     AWLVAL_MACRO,
     AWLVAL_DICT,
+    AWLVAL_CHAN,
+    AWLVAL_GEN,
 
     AWLVAL_SEXPR,
     AWLVAL_QEXPR,
@@ -32,10 +49,17 @@ typedef enum {
     AWLVAL_CEXPR
 } awlval_type_t;
 
+/* Small integers and booleans are preallocated, immortal values */
+#define AWLVAL_IMMORTAL -1
+#define AWLVAL_SMALL_INT_MIN -256
+#define AWLVAL_SMALL_INT_MAX 1023
+
 #define ISNUMERIC(t) (t == AWLVAL_INT || t == AWLVAL_FLOAT)
 #define ISORDEREDCOLLECTION(t) (t == AWLVAL_QEXPR || t == AWLVAL_STR || t == AWLVAL_QSYM)
 #define ISCOLLECTION(t) (t == AWLVAL_QEXPR || t == AWLVAL_STR || t == AWLVAL_QSYM || t == AWLVAL_DICT)
 #define ISEXPR(t) (t == AWLVAL_QEXPR || t == AWLVAL_SEXPR)
+#define AWLVAL_MAX_FORMALS USHRT_MAX
+
 #define ISCALLABLE(t) (t == AWLVAL_BUILTIN || t == AWLVAL_FN || t == AWLVAL_MACRO)
 
 char* awlval_type_name(awlval_type_t t);
@@ -47,8 +71,16 @@ typedef awlval*(*awlbuiltin)(awlenv*, awlval*);
 
 struct awlval {
     awlval_type_t type;
+    /* values are immutable once shared; refs counts the holders */
+    int refs;
+    /* an argument list the VM has already evaluated */
+    bool evaluated;
     int count;
     awlval** cell;
+    /* cell points offset slots into an array with room for capacity cells,
+     * so that both ends can grow and shrink in amortized O(1) */
+    int offset;
+    int capacity;
 
     /* collection types have length */
     int length;
@@ -59,52 +91,104 @@ struct awlval {
         long lng;
         double dbl;
         char* sym;
-        char* str;
         bool bln;
 
-        /* dict type */
-        dict* d;
+        /* string type: length characters from str, which points into strbuf
+         * and is only NUL terminated if it ends where strbuf does */
+        struct {
+            char* str;
+            awlstr* strbuf;
+        };
+
+        /* dict type, see hamt.h */
+        hamt_node* map;
+
+        /* channel type, see sched.h; shared by every copy of the value */
+        awlchan* chan;
+
+        /* generator type, see sched.h; likewise shared */
+        awlgen* gen;
+
+        /* expression types: a view borrows its cells from backing, which it
+         * keeps alive; the cells are copied out before any mutation. A call
+         * folded when it was parsed keeps its value in folded (see fold.h) */
+        struct {
+            awlval* backing;
+            awlval* folded;
+        };
 
         /* function types */
         struct {
             awlbuiltin builtin;
             char* builtin_name;
         };
+        /* formals are never consumed: env binds the first bound of them
+         * by slot, so partial application only needs a new frame. arity
+         * counts the formals before '&', if variadic */
         struct {
             awlenv* env;
             awlval* formals;
             awlval* body;
             bool called;
+            bool variadic;
+            unsigned short arity;
+            unsigned short bound;
         };
     };
 };
 
 struct awlenv {
     awlenv* parent;
+    /* the frame of a function binds its formals by position: slots[i]
+     * holds the value of slot_names->cell[i], or NULL until it is bound.
+     * Anything else is bound by name in internal_dict, which is only
+     * allocated once it is needed */
+    awlval* slot_names;
+    awlval** slots;
     dict* internal_dict;
     bool top_level;
+    /* some cached lookup depends on this frame's chain staying as it is,
+     * see awlenv_version */
+    bool cache_key;
     int references;
+    /* when the frame was made, counting the frames made on this thread;
+     * see awlenv_freeze */
+    unsigned long serial;
+
+    /* collector bookkeeping, see gc.h */
+    awlenv* gc_prev;
+    awlenv* gc_next;
+    int gc_refs;
+    bool gc_marked;
 };
 
 /* awlval instantiation functions */
+void setup_immediates(void);
 awlval* awlval_err(const char* fmt, ...);
 awlval* awlval_int(long x);
 awlval* awlval_float(double x);
 awlval* awlval_sym(const char* s);
 awlval* awlval_qsym(const char* s);
 awlval* awlval_str(const char* s);
+awlval* awlval_strn(const char* s, int length);
 awlval* awlval_bool(bool b);
 awlval* awlval_fun(const awlbuiltin builtin, const char* builtin_name);
 awlval* awlval_lambda(awlenv* closure, awlval* formals, awlval* body);
 awlval* awlval_macro(awlenv* closure, awlval* formals, awlval* body);
+awlval* awlval_applied(const awlval* f, awlenv* env, int bound);
+awlval* awlval_body(awlenv* env, awlval* body);
 awlval* awlval_dict(void);
+awlval* awlval_chan(void);
+awlval* awlval_gen(awlenv* e, awlval* f, awlval* args);
 awlval* awlval_sexpr(void);
 awlval* awlval_qexpr(void);
 awlval* awlval_eexpr(void);
 awlval* awlval_cexpr(void);
 
 /* awlval manipulation functions */
+awlval* awlval_retain(awlval* v);
 void awlval_del(awlval* v);
+awlval* awlval_unshare(awlval* v);
 awlval* awlval_add(awlval* v, awlval* x);
 awlval* awlval_add_front(awlval* v, awlval* x);
 
@@ -123,11 +207,9 @@ awlval* awlval_shift(awlval* x, awlval* y, int i);
 awlval* awlval_reverse(awlval* x);
 awlval* awlval_slice(awlval* x, int start, int end);
 awlval* awlval_slice_step(awlval* x, int start, int end, int step);
-void awlval_maybe_promote_numeric(awlval* a, awlval* b);
-void awlval_promote_numeric(awlval* a);
-void awlval_demote_numeric(awlval* a);
+const char* awlval_str_cstr(awlval* v);
 awlval* awlval_copy(const awlval* v);
-awlval* awlval_convert(awlval_type_t t, const awlval* v);
+awlval* awlval_convert(awlval_type_t t, awlval* v);
 bool awlval_eq(awlval* x, awlval* y);
 
 /* awlval utility functions */
@@ -135,15 +217,36 @@ bool is_awlval_empty_qexpr(awlval* x);
 
 /* awlenv functions */
 awlenv* awlenv_new(void);
+awlenv* awlenv_new_slots(awlval* names);
 awlenv* awlenv_new_top_level(void);
 void awlenv_del(awlenv* e);
 void awlenv_del_top_level(awlenv* e);
+void awlenv_clear(awlenv* e);
 int awlenv_index(awlenv* e, awlval* k);
 awlval* awlenv_get(awlenv* e, awlval* k);
+awlval* awlenv_get_at(awlenv* e, int depth, int slot, awlval* k);
+
+/* Bumped whenever a name is bound in any frame's bindings dict, and when a
+ * frame marked as a cache_key goes away. A lookup that awlenv_get_cached
+ * reports as cacheable, made from a frame whose chain leads through outer,
+ * gives the same binding from any frame leading through outer until the
+ * version changes */
+unsigned long awlenv_version(void);
+awlval* awlenv_get_cached(awlenv* e, awlval* k, awlenv* outer, bool* cacheable);
 void awlenv_put(awlenv* e, awlval* k, awlval* v);
+void awlenv_put_slot(awlenv* e, int slot, awlval* v);
 void awlenv_put_global(awlenv* e, awlval* k, awlval* v);
 awlenv* awlenv_copy(awlenv* e);
 
+/* Frames made on this thread before awlenv_freeze stay frozen until the
+ * awlenv_thaw given what it returned: nothing may be bound in them, so
+ * that the function of a parallel builtin sees, and leaves, the same
+ * bindings on whichever thread it runs. awlenv_frozen tells whether
+ * define in e, or global from e, would bind in a frozen frame */
+unsigned long awlenv_freeze(void);
+void awlenv_thaw(unsigned long mark);
+bool awlenv_frozen(const awlenv* e, bool global);
+
 void awlenv_add_builtin(awlenv* e, char* name, awlbuiltin func);
 void awlenv_add_builtins(awlenv* e);
 void awlenv_add_core_lib(awlenv* e);
@@ -15,6 +15,15 @@ static inline void* safe_malloc(size_t size) {
     return p;
 }
 
+static inline void* safe_realloc(void* ptr, size_t size) {
+    char* p = realloc(ptr, size);
+    if (p == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        exit(-1);
+    }
+    return p;
+}
+
 typedef struct {
     int length;
     int size;
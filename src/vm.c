@@ -0,0 +1,1011 @@
+#include "vm.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+
+#include "builtins.h"
+#include "eval.h"
+#include "gc.h"
+#include "print.h"
+#include "util.h"
+
+#define VM_CHUNK_INITIAL_SIZE 16
+#define VM_STACK_INITIAL_SIZE 64
+#define VM_FRAMES_INITIAL_SIZE 16
+#define VM_CACHE_INITIAL_SIZE 64
+
+typedef enum {
+    OP_CONST,       /* push consts[a] */
+    OP_LOOKUP,      /* push the value bound to the symbol consts[a] */
+    OP_LOCAL,       /* push the value of the symbol consts[a], resolved to
+                       slot b of the frame depth frames out */
+    OP_EVAL,        /* push the tree-walking evaluation of consts[a] */
+    OP_JUMP,        /* continue at a */
+    OP_GUARD,       /* continue at b unless consts[a] names the special form */
+    OP_FOLDED,      /* continue at b unless consts[a] names the builtin of
+                       that name, which a call was folded with */
+    OP_BRANCH,      /* pop the condition of an 'if'; continue at a if false */
+    OP_DROP,        /* pop a value and discard it */
+    OP_SHORT,       /* check the first operand of an 'and' or 'or'; if it
+                       decides the result, keep it and continue at a */
+    OP_TEST,        /* check the second operand of an 'and' or 'or' */
+    OP_UNBOUND,     /* fail if consts[a] is bound in the innermost frame */
+    OP_DEFINE,      /* bind consts[a] to the top of the stack, globally if b */
+    OP_LAMBDA,      /* push a closure with formals consts[a] and body consts[b] */
+    OP_LET,         /* enter a new innermost frame with slots consts[a] */
+    OP_BIND,        /* pop a value and bind consts[a] to it */
+    OP_UNLET,       /* leave the innermost frame */
+    OP_CALLEE,      /* check the callee on top of the stack; one that wants
+                       its arguments unevaluated is applied to those of the
+                       form consts[a] instead, continuing at b */
+    OP_CALL,        /* apply the callee below the top a values to them */
+    OP_TAIL_CALL,   /* as OP_CALL, but in place of the current frame */
+    OP_RETURN
+} vm_op;
+
+typedef enum {
+    VM_FORM_IF,
+    VM_FORM_DO,
+    VM_FORM_DEFINE,
+    VM_FORM_GLOBAL,
+    VM_FORM_LET,
+    VM_FORM_FN,
+    VM_FORM_AND,
+    VM_FORM_OR,
+    VM_FORM_COUNT
+} vm_form;
+
+static const struct {
+    const char* name;
+    awlbuiltin builtin;
+} vm_forms[VM_FORM_COUNT] = {
+    { "if", builtin_if },
+    { "do", builtin_do },
+    { "define", builtin_define },
+    { "global", builtin_global },
+    { "let", builtin_let },
+    { "fn", builtin_lambda },
+    { "and", builtin_and },
+    { "or", builtin_or }
+};
+
+typedef struct {
+    unsigned char op;
+    unsigned char form;
+    unsigned short depth;
+    int a;
+    int b;
+} vm_instr;
+
+/* The names bound by position in each frame the compiled code will run
+ * in, innermost first */
+typedef struct vm_scope {
+    awlval* names;
+    struct vm_scope* parent;
+} vm_scope;
+
+#define VM_SCOPE_MAX_DEPTH USHRT_MAX
+
+/* Inline cache for the lookup of a symbol constant (see awlenv_version).
+ * The value is borrowed from the frame that binds it, which cannot let go
+ * of it without bumping the version */
+typedef struct {
+    unsigned long version;
+    awlenv* outer;
+    awlval* value;
+} vm_site;
+
+typedef struct {
+    vm_instr* code;
+    int count;
+    int size;
+    awlval** consts;
+    /* one for each constant */
+    vm_site* sites;
+    int const_count;
+    int const_size;
+} vm_chunk;
+
+static _Thread_local bool enabled = false;
+
+void vm_enable(bool e) {
+    enabled = e;
+}
+
+bool vm_enabled(void) {
+    return enabled;
+}
+
+/* Builtins that evaluate their arguments themselves, if at all; calls to
+ * anything else can be given arguments the VM has already evaluated */
+static bool vm_is_strict(const awlval* f) {
+    static const awlbuiltin lazy[] = {
+        builtin_if, builtin_do, builtin_define, builtin_global, builtin_let,
+        builtin_lambda, builtin_macro, builtin_and, builtin_or,
+        builtin_random, builtin_gc, builtin_gcstats, builtin_exit
+    };
+
+    for (int i = 0; i < sizeof(lazy) / sizeof(lazy[0]); i++) {
+        if (f->builtin == lazy[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Compilation */
+static vm_chunk* chunk_new(void) {
+    vm_chunk* c = safe_malloc(sizeof(vm_chunk));
+    c->count = 0;
+    c->size = VM_CHUNK_INITIAL_SIZE;
+    c->code = safe_malloc(sizeof(vm_instr) * c->size);
+    c->const_count = 0;
+    c->const_size = VM_CHUNK_INITIAL_SIZE;
+    c->consts = safe_malloc(sizeof(awlval*) * c->const_size);
+    c->sites = safe_malloc(sizeof(vm_site) * c->const_size);
+    return c;
+}
+
+static void chunk_del(vm_chunk* c) {
+    for (int i = 0; i < c->const_count; i++) {
+        awlval_del(c->consts[i]);
+    }
+    free(c->consts);
+    free(c->sites);
+    free(c->code);
+    free(c);
+}
+
+static int emit(vm_chunk* c, vm_op op, int a, int b) {
+    if (c->count == c->size) {
+        c->size *= 2;
+        c->code = safe_realloc(c->code, sizeof(vm_instr) * c->size);
+    }
+    vm_instr* in = &c->code[c->count];
+    in->op = op;
+    in->form = 0;
+    in->depth = 0;
+    in->a = a;
+    in->b = b;
+    return c->count++;
+}
+
+static int add_const(vm_chunk* c, awlval* v) {
+    if (c->const_count == c->const_size) {
+        c->const_size *= 2;
+        c->consts = safe_realloc(c->consts, sizeof(awlval*) * c->const_size);
+        c->sites = safe_realloc(c->sites, sizeof(vm_site) * c->const_size);
+    }
+    c->consts[c->const_count] = awlval_retain(v);
+    c->sites[c->const_count].version = 0;
+    return c->const_count++;
+}
+
+static bool has_escapes(const awlval* v) {
+    if (v->type == AWLVAL_EEXPR || v->type == AWLVAL_CEXPR) {
+        return true;
+    }
+    if (ISEXPR(v->type)) {
+        for (int i = 0; i < v->count; i++) {
+            if (has_escapes(v->cell[i])) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/* Forms of the wrong shape are left to the builtin, which reports why */
+static bool form_is_valid(vm_form form, const awlval* v) {
+    switch (form) {
+        case VM_FORM_IF:
+            return v->count == 4;
+
+        case VM_FORM_DO:
+            return v->count >= 2;
+
+        case VM_FORM_DEFINE:
+        case VM_FORM_GLOBAL:
+            return v->count == 3 && v->cell[1]->type == AWLVAL_SYM;
+
+        case VM_FORM_FN:
+            if (v->count != 3 || !ISEXPR(v->cell[1]->type)) {
+                return false;
+            }
+            for (int i = 0; i < v->cell[1]->count; i++) {
+                if (v->cell[1]->cell[i]->type != AWLVAL_SYM) {
+                    return false;
+                }
+            }
+            return true;
+
+        case VM_FORM_LET:
+            if (v->count != 3 || v->cell[1]->type != AWLVAL_SEXPR) {
+                return false;
+            }
+            for (int i = 0; i < v->cell[1]->count; i++) {
+                awlval* binding = v->cell[1]->cell[i];
+                if (binding->type != AWLVAL_SEXPR || binding->count != 2
+                        || binding->cell[0]->type != AWLVAL_SYM) {
+                    return false;
+                }
+            }
+            return true;
+
+        case VM_FORM_AND:
+        case VM_FORM_OR:
+            return v->count == 3;
+
+        default:
+            return false;
+    }
+}
+
+static void compile_expr(vm_chunk* c, vm_scope* scope, awlval* v, bool tail);
+
+static void compile_form(vm_chunk* c, vm_scope* scope, vm_form form, awlval* v, bool tail) {
+    int guard = emit(c, OP_GUARD, add_const(c, v->cell[0]), 0);
+    c->code[guard].form = form;
+
+    switch (form) {
+        case VM_FORM_IF:
+        {
+            compile_expr(c, scope, v->cell[1], false);
+            int branch = emit(c, OP_BRANCH, 0, 0);
+            compile_expr(c, scope, v->cell[2], tail);
+            int end = emit(c, OP_JUMP, 0, 0);
+            c->code[branch].a = c->count;
+            compile_expr(c, scope, v->cell[3], tail);
+            c->code[end].a = c->count;
+            break;
+        }
+
+        case VM_FORM_DO:
+            for (int i = 1; i < v->count - 1; i++) {
+                compile_expr(c, scope, v->cell[i], false);
+                emit(c, OP_DROP, 0, 0);
+            }
+            compile_expr(c, scope, v->cell[v->count - 1], tail);
+            break;
+
+        case VM_FORM_DEFINE:
+        case VM_FORM_GLOBAL:
+        {
+            int sym = add_const(c, v->cell[1]);
+            emit(c, OP_UNBOUND, sym, 0);
+            compile_expr(c, scope, v->cell[2], false);
+            emit(c, OP_DEFINE, sym, form == VM_FORM_GLOBAL);
+            break;
+        }
+
+        case VM_FORM_FN:
+            emit(c, OP_LAMBDA, add_const(c, v->cell[1]), add_const(c, v->cell[2]));
+            break;
+
+        case VM_FORM_LET:
+        {
+            awlval* bindings = v->cell[1];
+            /* names are checked against the enclosing frame */
+            for (int i = 0; i < bindings->count; i++) {
+                emit(c, OP_UNBOUND, add_const(c, bindings->cell[i]->cell[0]), 0);
+            }
+
+            awlval* names = awlval_sexpr();
+            for (int i = 0; i < bindings->count; i++) {
+                names = awlval_add(names, awlval_retain(bindings->cell[i]->cell[0]));
+            }
+            emit(c, OP_LET, add_const(c, names), 0);
+
+            /* later bindings see earlier ones */
+            vm_scope inner = { names, scope };
+            awlval_del(names);
+            for (int i = 0; i < bindings->count; i++) {
+                compile_expr(c, &inner, bindings->cell[i]->cell[1], false);
+                emit(c, OP_BIND, add_const(c, bindings->cell[i]->cell[0]), 0);
+            }
+            compile_expr(c, &inner, v->cell[2], tail);
+            emit(c, OP_UNLET, 0, 0);
+            break;
+        }
+
+        case VM_FORM_AND:
+        case VM_FORM_OR:
+        {
+            compile_expr(c, scope, v->cell[1], false);
+            int shortcut = emit(c, OP_SHORT, 0, 0);
+            c->code[shortcut].form = form;
+            compile_expr(c, scope, v->cell[2], false);
+            int test = emit(c, OP_TEST, 0, 0);
+            c->code[test].form = form;
+            c->code[shortcut].a = c->count;
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    /* the symbol has been rebound, so let the tree walker have it */
+    int end = emit(c, OP_JUMP, 0, 0);
+    c->code[guard].b = c->count;
+    emit(c, OP_EVAL, add_const(c, v), 0);
+    c->code[end].a = c->count;
+}
+
+static void compile_call(vm_chunk* c, vm_scope* scope, awlval* v, bool tail) {
+    compile_expr(c, scope, v->cell[0], false);
+    int callee = emit(c, OP_CALLEE, add_const(c, v), 0);
+    for (int i = 1; i < v->count; i++) {
+        compile_expr(c, scope, v->cell[i], false);
+    }
+    emit(c, tail ? OP_TAIL_CALL : OP_CALL, v->count - 1, 0);
+    c->code[callee].b = c->count;
+}
+
+static void compile_sexpr(vm_chunk* c, vm_scope* scope, awlval* v, bool tail) {
+    if (v->cell[0]->type == AWLVAL_SYM) {
+        for (int form = 0; form < VM_FORM_COUNT; form++) {
+            if (streq(v->cell[0]->sym, vm_forms[form].name)) {
+                if (form_is_valid(form, v)) {
+                    compile_form(c, scope, form, v, tail);
+                    return;
+                }
+                break;
+            }
+        }
+    }
+    compile_call(c, scope, v, tail);
+}
+
+static void compile_fold_guards(vm_chunk* c, awlval* v) {
+    emit(c, OP_FOLDED, add_const(c, v->cell[0]), 0);
+    for (int i = 1; i < v->count; i++) {
+        if (v->cell[i]->type == AWLVAL_SEXPR) {
+            compile_fold_guards(c, v->cell[i]);
+        }
+    }
+}
+
+/* A folded call is its value, as long as the builtins it was folded with
+ * are still bound; otherwise it is compiled as usual (see fold.h) */
+static void compile_folded(vm_chunk* c, vm_scope* scope, awlval* v, bool tail) {
+    int guards = c->count;
+    compile_fold_guards(c, v);
+    emit(c, OP_CONST, add_const(c, v->folded), 0);
+    int end = emit(c, OP_JUMP, 0, 0);
+
+    for (int i = guards; i < end - 1; i++) {
+        c->code[i].b = c->count;
+    }
+    compile_sexpr(c, scope, v, tail);
+    c->code[end].a = c->count;
+}
+
+static void compile_symbol(vm_chunk* c, vm_scope* scope, awlval* v) {
+    int depth = 0;
+    for (; scope && depth <= VM_SCOPE_MAX_DEPTH; scope = scope->parent, depth++) {
+        for (int i = 0; i < scope->names->count; i++) {
+            if (scope->names->cell[i]->sym == v->sym) {
+                int local = emit(c, OP_LOCAL, add_const(c, v), i);
+                c->code[local].depth = depth;
+                return;
+            }
+        }
+    }
+    emit(c, OP_LOOKUP, add_const(c, v), 0);
+}
+
+static void compile_expr(vm_chunk* c, vm_scope* scope, awlval* v, bool tail) {
+    switch (v->type) {
+        case AWLVAL_SYM:
+            compile_symbol(c, scope, v);
+            break;
+
+        case AWLVAL_SEXPR:
+            if (v->count == 0) {
+                emit(c, OP_EVAL, add_const(c, v), 0);
+            } else if (v->folded) {
+                compile_folded(c, scope, v, tail);
+            } else {
+                compile_sexpr(c, scope, v, tail);
+            }
+            break;
+
+        case AWLVAL_QEXPR:
+            emit(c, has_escapes(v) ? OP_EVAL : OP_CONST, add_const(c, v), 0);
+            break;
+
+        case AWLVAL_EEXPR:
+        case AWLVAL_CEXPR:
+            emit(c, OP_EVAL, add_const(c, v), 0);
+            break;
+
+        default:
+            emit(c, OP_CONST, add_const(c, v), 0);
+            break;
+    }
+}
+
+/* Compile v to run in a frame with slots names, or NULL */
+static vm_chunk* vm_compile(awlval* v, awlval* names) {
+    vm_chunk* c = chunk_new();
+    vm_scope scope = { names, NULL };
+    compile_expr(c, names ? &scope : NULL, v, true);
+    emit(c, OP_RETURN, 0, 0);
+    return c;
+}
+
+/* Compiled function bodies, keyed by the address of the body and of the
+ * formals it was resolved against. Each entry holds its body, so entries
+ * only the cache refers to can be dropped when it fills up */
+typedef struct {
+    awlval* body;
+    awlval* names;
+    vm_chunk* chunk;
+} vm_cache_entry;
+
+static _Thread_local vm_cache_entry* cache = NULL;
+static _Thread_local int cache_size = 0;
+static _Thread_local int cache_count = 0;
+
+static unsigned int cache_hash(const awlval* body, const awlval* names) {
+    uintptr_t x = ((uintptr_t)body >> 3) ^ ((uintptr_t)names >> 2);
+    return (unsigned int)(x ^ (x >> 16));
+}
+
+static vm_cache_entry* cache_slot(vm_cache_entry* t, int size,
+        const awlval* body, const awlval* names) {
+    unsigned int i = cache_hash(body, names) & (size - 1);
+    while (t[i].body && (t[i].body != body || t[i].names != names)) {
+        i = (i + 1) & (size - 1);
+    }
+    return &t[i];
+}
+
+static void cache_entry_del(vm_cache_entry* entry) {
+    awlval_del(entry->body);
+    if (entry->names) {
+        awlval_del(entry->names);
+    }
+    chunk_del(entry->chunk);
+}
+
+static void cache_rebuild(int size) {
+    vm_cache_entry* t = safe_malloc(sizeof(vm_cache_entry) * size);
+    memset(t, 0, sizeof(vm_cache_entry) * size);
+
+    cache_count = 0;
+    for (int i = 0; i < cache_size; i++) {
+        if (!cache[i].body) {
+            continue;
+        }
+        if (cache[i].body->refs == 1) {
+            cache_entry_del(&cache[i]);
+        } else {
+            *cache_slot(t, size, cache[i].body, cache[i].names) = cache[i];
+            cache_count++;
+        }
+    }
+
+    free(cache);
+    cache = t;
+    cache_size = size;
+}
+
+static vm_chunk* vm_body_chunk(awlval* body, awlval* names) {
+    vm_cache_entry* entry = cache ? cache_slot(cache, cache_size, body, names) : NULL;
+    if (entry && entry->body) {
+        return entry->chunk;
+    }
+
+    if ((cache_count + 1) * 4 > cache_size * 3) {
+        /* drop what is no longer reachable before growing */
+        cache_rebuild(cache_size ? cache_size : VM_CACHE_INITIAL_SIZE);
+        if ((cache_count + 1) * 2 > cache_size) {
+            cache_rebuild(cache_size * 2);
+        }
+    }
+
+    entry = cache_slot(cache, cache_size, body, names);
+    entry->body = awlval_retain(body);
+    entry->names = names ? awlval_retain(names) : NULL;
+    entry->chunk = vm_compile(body, names);
+    cache_count++;
+    return entry->chunk;
+}
+
+void teardown_vm(void) {
+    for (int i = 0; i < cache_size; i++) {
+        if (cache[i].body) {
+            cache_entry_del(&cache[i]);
+        }
+    }
+    free(cache);
+    cache = NULL;
+    cache_size = 0;
+    cache_count = 0;
+}
+
+/* Execution */
+typedef struct {
+    vm_chunk* chunk;
+    /* keeps a cached chunk from being dropped while it runs; NULL for the
+     * top-level form */
+    awlval* body;
+    int ip;
+    /* the innermost frame, including any entered by 'let' */
+    awlenv* env;
+    /* the first frame out that the chunk was not compiled for: the parent
+     * of a function's frame, or the frame a top-level form runs in */
+    awlenv* outer;
+} vm_frame;
+
+typedef struct {
+    awlval** stack;
+    int sp;
+    int stack_size;
+    vm_frame* frames;
+    int fp;
+    int frames_size;
+    /* calls to println whose arguments are being evaluated; as under the
+     * tree walker, each ends its line if one of them fails */
+    int lines;
+} vm_state;
+
+static void vm_push(vm_state* vm, awlval* v) {
+    if (vm->sp == vm->stack_size) {
+        vm->stack_size *= 2;
+        vm->stack = safe_realloc(vm->stack, sizeof(awlval*) * vm->stack_size);
+    }
+    vm->stack[vm->sp++] = v;
+}
+
+static awlval* vm_pop(vm_state* vm) {
+    return vm->stack[--vm->sp];
+}
+
+/* Frames count towards the evaluation depth; if there is no room for
+ * another, what it would have held is released and the error returned */
+static awlval* vm_push_frame(vm_state* vm, vm_chunk* chunk, awlval* body, awlenv* env, awlenv* outer) {
+    awlval* err = awlval_eval_descend();
+    if (err) {
+        awlenv_del(env);
+        if (body) {
+            awlval_del(body);
+        }
+        return err;
+    }
+
+    if (vm->fp == vm->frames_size) {
+        vm->frames_size *= 2;
+        vm->frames = safe_realloc(vm->frames, sizeof(vm_frame) * vm->frames_size);
+    }
+    vm_frame* f = &vm->frames[vm->fp++];
+    f->chunk = chunk;
+    f->body = body;
+    f->ip = 0;
+    f->env = env;
+    f->outer = outer;
+    return NULL;
+}
+
+static void vm_release_frame(vm_frame* f) {
+    awlenv_del(f->env);
+    if (f->body) {
+        awlval_del(f->body);
+    }
+}
+
+static void vm_pop_frame(vm_state* vm) {
+    vm_release_frame(&vm->frames[--vm->fp]);
+    awlval_eval_ascend();
+}
+
+static awlval* vm_enter_frame(vm_state* vm, awlenv* env, awlval* body, bool tail) {
+    vm_chunk* chunk = vm_body_chunk(body, env->slot_names);
+    if (!tail) {
+        return vm_push_frame(vm, chunk, body, env, env->parent);
+    }
+
+    vm_frame* f = &vm->frames[vm->fp - 1];
+    vm_release_frame(f);
+    f->chunk = chunk;
+    f->body = body;
+    f->ip = 0;
+    f->env = env;
+    f->outer = env->parent;
+    return NULL;
+}
+
+/* Run the body of a function whose arguments are all bound */
+static awlval* vm_enter(vm_state* vm, awlval* fn, bool tail) {
+    /* as in awlval_eval, a frame made for this call alone is used directly */
+    awlenv* env;
+    if (fn->refs == 1) {
+        env = fn->env;
+        env->references++;
+    } else {
+        env = awlenv_copy(fn->env);
+    }
+    awlval* body = awlval_retain(fn->body);
+    awlval_del(fn);
+    return vm_enter_frame(vm, env, body, tail);
+}
+
+/* Whether a call binds the remaining formals of fn to exactly count
+ * arguments, so that the VM can bind them itself */
+static bool vm_binds_all(const awlval* fn, int count) {
+    return fn->type == AWLVAL_FN && !fn->variadic && fn->arity - fn->bound == count;
+}
+
+/* Look up the symbol constant i, through its inline cache */
+static awlval* vm_lookup(vm_frame* f, int i) {
+    vm_site* site = &f->chunk->sites[i];
+    unsigned long version = awlenv_version();
+    if (site->version == version && site->outer == f->outer) {
+        return awlval_retain(site->value);
+    }
+
+    bool cacheable;
+    awlval* x = awlenv_get_cached(f->env, f->chunk->consts[i], f->outer, &cacheable);
+    if (cacheable) {
+        f->outer->cache_key = true;
+        site->version = version;
+        site->outer = f->outer;
+        site->value = x;
+    }
+    return x;
+}
+
+static awlval* vm_bool_err(vm_form form, int arg, const awlval* x) {
+    return awlval_err("function '%s' passed incorrect type for arg %i; got %s, expected %s",
+            vm_forms[form].name, arg, awlval_type_name(x->type), awlval_type_name(AWLVAL_BOOL));
+}
+
+static awlval* vm_run(awlenv* e, vm_chunk* chunk) {
+    vm_state vm;
+    vm.sp = 0;
+    vm.stack_size = VM_STACK_INITIAL_SIZE;
+    vm.stack = safe_malloc(sizeof(awlval*) * vm.stack_size);
+    vm.fp = 0;
+    vm.frames_size = VM_FRAMES_INITIAL_SIZE;
+    vm.frames = safe_malloc(sizeof(vm_frame) * vm.frames_size);
+    vm.lines = 0;
+
+    e->references++;
+    awlval* result = vm_push_frame(&vm, chunk, NULL, e, e);
+    if (result) {
+        goto done;
+    }
+
+    while (true) {
+        vm_frame* f = &vm.frames[vm.fp - 1];
+        vm_instr* in = &f->chunk->code[f->ip++];
+        awlval** consts = f->chunk->consts;
+
+        switch (in->op) {
+            case OP_CONST:
+                vm_push(&vm, awlval_retain(consts[in->a]));
+                break;
+
+            case OP_LOOKUP:
+            {
+                awlval* x = vm_lookup(f, in->a);
+                if (x->type == AWLVAL_ERR) {
+                    result = x;
+                    goto fail;
+                }
+                vm_push(&vm, x);
+                break;
+            }
+
+            case OP_LOCAL:
+            {
+                awlval* x = awlenv_get_at(f->env, in->depth, in->b, consts[in->a]);
+                if (x->type == AWLVAL_ERR) {
+                    result = x;
+                    goto fail;
+                }
+                vm_push(&vm, x);
+                break;
+            }
+
+            case OP_EVAL:
+            {
+                awlval* x = awlval_eval(f->env, awlval_retain(consts[in->a]));
+                if (x->type == AWLVAL_ERR) {
+                    result = x;
+                    goto fail;
+                }
+                vm_push(&vm, x);
+                break;
+            }
+
+            case OP_JUMP:
+                f->ip = in->a;
+                break;
+
+            case OP_GUARD:
+            {
+                awlval* x = vm_lookup(f, in->a);
+                bool bound = x->type == AWLVAL_BUILTIN && x->builtin == vm_forms[in->form].builtin;
+                awlval_del(x);
+                if (!bound) {
+                    f->ip = in->b;
+                }
+                break;
+            }
+
+            case OP_FOLDED:
+            {
+                awlval* x = vm_lookup(f, in->a);
+                bool bound = x->type == AWLVAL_BUILTIN && x->builtin_name == consts[in->a]->sym;
+                awlval_del(x);
+                if (!bound) {
+                    f->ip = in->b;
+                }
+                break;
+            }
+
+            case OP_BRANCH:
+            {
+                awlval* x = vm_pop(&vm);
+                if (x->type != AWLVAL_BOOL) {
+                    result = vm_bool_err(VM_FORM_IF, 0, x);
+                    awlval_del(x);
+                    goto fail;
+                }
+                if (!x->bln) {
+                    f->ip = in->a;
+                }
+                awlval_del(x);
+                break;
+            }
+
+            case OP_DROP:
+                awlval_del(vm_pop(&vm));
+                break;
+
+            case OP_SHORT:
+            {
+                awlval* x = vm.stack[vm.sp - 1];
+                if (x->type != AWLVAL_BOOL) {
+                    result = vm_bool_err(in->form, 0, x);
+                    goto fail;
+                }
+                if (x->bln == (in->form == VM_FORM_OR)) {
+                    f->ip = in->a;
+                } else {
+                    awlval_del(vm_pop(&vm));
+                }
+                break;
+            }
+
+            case OP_TEST:
+            {
+                awlval* x = vm.stack[vm.sp - 1];
+                if (x->type != AWLVAL_BOOL) {
+                    result = vm_bool_err(in->form, 1, x);
+                    goto fail;
+                }
+                break;
+            }
+
+            case OP_UNBOUND:
+                if (awlenv_index(f->env, consts[in->a]) != -1) {
+                    result = awlval_err("cannot redefine '%s'", consts[in->a]->sym);
+                    goto fail;
+                }
+                break;
+
+            case OP_DEFINE:
+            {
+                awlval* x = vm_pop(&vm);
+                if (awlenv_frozen(f->env, in->b)) {
+                    awlval_del(x);
+                    result = awlval_err("function '%s' cannot bind outside the function of a parallel call",
+                            in->b ? "global" : "define");
+                    goto fail;
+                }
+                if (in->b) {
+                    awlenv_put_global(f->env, consts[in->a], x);
+                } else {
+                    awlenv_put(f->env, consts[in->a], x);
+                }
+                vm_push(&vm, x);
+                break;
+            }
+
+            case OP_LAMBDA:
+                vm_push(&vm, awlval_lambda(f->env,
+                            awlval_retain(consts[in->a]), awlval_retain(consts[in->b])));
+                break;
+
+            case OP_LET:
+            {
+                /* the new frame takes over the reference to its parent */
+                awlenv* l = awlenv_new_slots(consts[in->a]);
+                l->parent = f->env;
+                f->env = l;
+                break;
+            }
+
+            case OP_BIND:
+            {
+                awlval* x = vm_pop(&vm);
+                awlenv_put(f->env, consts[in->a], x);
+                awlval_del(x);
+                break;
+            }
+
+            case OP_UNLET:
+            {
+                awlenv* parent = f->env->parent;
+                parent->references++;
+                awlenv_del(f->env);
+                f->env = parent;
+                break;
+            }
+
+            case OP_CALLEE:
+            {
+                awlval* fn = vm.stack[vm.sp - 1];
+                if (!ISCALLABLE(fn->type)) {
+                    result = awlval_err("cannot evaluate %s; incorrect type for arg 0; got %s, expected callable",
+                            awlval_type_name(AWLVAL_SEXPR), awlval_type_name(fn->type));
+                    goto fail;
+                }
+                if (fn->type != AWLVAL_MACRO && (fn->type != AWLVAL_BUILTIN || vm_is_strict(fn))) {
+                    if (fn->type == AWLVAL_BUILTIN && fn->builtin == builtin_println) {
+                        vm.lines++;
+                    }
+                    break;
+                }
+
+                vm.sp--;
+                awlval* form = consts[in->a];
+                /* the call this stands in for is the one just before b */
+                bool tail = f->chunk->code[in->b - 1].op == OP_TAIL_CALL;
+                awlval* args = awlval_sexpr();
+                for (int i = 1; i < form->count; i++) {
+                    args = awlval_add(args, awlval_retain(form->cell[i]));
+                }
+                f->ip = in->b;
+
+                awlval* x = fn->type == AWLVAL_MACRO
+                    ? awlval_expand(f->env, fn, form, args)
+                    : awlval_call(f->env, fn, args);
+                awlval_del(fn);
+                if (x->type == AWLVAL_FN && x->called) {
+                    result = vm_enter(&vm, x, tail);
+                    if (result) {
+                        goto fail;
+                    }
+                    break;
+                }
+
+                /* the result is evaluated in turn, as in awlval_eval */
+                x = awlval_eval(f->env, x);
+                if (x->type == AWLVAL_ERR) {
+                    result = x;
+                    goto fail;
+                }
+                vm_push(&vm, x);
+                break;
+            }
+
+            case OP_CALL:
+            case OP_TAIL_CALL:
+            {
+                if (awlval_eval_pending()) {
+                    result = awlval_eval_safe_point();
+                    if (result) {
+                        goto fail;
+                    }
+                }
+
+                /* everything is held by the stacks, so this is a safe point */
+                gc_maybe_collect();
+
+                awlval* fn = vm.stack[vm.sp - in->a - 1];
+                if (vm_binds_all(fn, in->a)) {
+                    /* bind into a fresh frame, as awlval_call does */
+                    awlenv* env = awlenv_copy(fn->env);
+                    for (int i = 0; i < in->a; i++) {
+                        awlval* x = vm.stack[vm.sp - in->a + i];
+                        awlenv_put_slot(env, fn->bound + i, x);
+                        awlval_del(x);
+                    }
+                    vm.sp -= in->a + 1;
+                    awlval* body = awlval_retain(fn->body);
+                    awlval_del(fn);
+                    result = vm_enter_frame(&vm, env, body, in->op == OP_TAIL_CALL);
+                    if (result) {
+                        goto fail;
+                    }
+                    break;
+                }
+
+                awlval* args = awlval_sexpr();
+                for (int i = vm.sp - in->a; i < vm.sp; i++) {
+                    args = awlval_add(args, vm.stack[i]);
+                }
+                vm.sp -= in->a + 1;
+                args->evaluated = true;
+
+                awlval* x;
+                if (fn->type == AWLVAL_BUILTIN) {
+                    if (fn->builtin == builtin_println) {
+                        vm.lines--;
+                    }
+                    x = fn->builtin(f->env, args);
+                } else {
+                    x = awlval_call(f->env, fn, args);
+                }
+                awlval_del(fn);
+
+                if (x->type == AWLVAL_FN && x->called) {
+                    result = vm_enter(&vm, x, in->op == OP_TAIL_CALL);
+                    if (result) {
+                        goto fail;
+                    }
+                    break;
+                }
+
+                /* the result is evaluated in turn, as in awlval_eval */
+                if (ISEXPR(x->type) || x->type == AWLVAL_SYM
+                        || x->type == AWLVAL_EEXPR || x->type == AWLVAL_CEXPR) {
+                    x = awlval_eval(f->env, x);
+                }
+                if (x->type == AWLVAL_ERR) {
+                    result = x;
+                    goto fail;
+                }
+                vm_push(&vm, x);
+                break;
+            }
+
+            case OP_RETURN:
+            {
+                awlval* x = vm_pop(&vm);
+                vm_pop_frame(&vm);
+                if (vm.fp == 0) {
+                    result = x;
+                    goto done;
+                }
+                vm_push(&vm, x);
+                break;
+            }
+        }
+    }
+
+fail:
+    for (; vm.lines > 0; vm.lines--) {
+        awl_printf("\n");
+    }
+    while (vm.sp > 0) {
+        awlval_del(vm_pop(&vm));
+    }
+    while (vm.fp > 0) {
+        vm_pop_frame(&vm);
+    }
+
+done:
+    free(vm.stack);
+    free(vm.frames);
+    return result;
+}
+
+awlval* vm_eval(awlenv* e, awlval* v) {
+    vm_chunk* c = vm_compile(v, NULL);
+    awlval* x = vm_run(e, c);
+    chunk_del(c);
+    awlval_del(v);
+    return x;
+}
+
+awlval* vm_eval_top(awlenv* e, awlval* v) {
+    return enabled ? vm_eval(e, v) : awlval_eval(e, v);
+}
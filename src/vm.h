@@ -0,0 +1,24 @@
+#ifndef AWL_VM_H
+#define AWL_VM_H
+
+#include <stdbool.h>
+
+#include "types.h"
+
+/* An alternative to the tree-walking awlval_eval: top-level forms and
+ * function bodies are compiled to bytecode for a stack machine. Special
+ * forms ('if', 'define', 'global', 'let', 'fn', 'and' and 'or') are
+ * compiled inline behind a guard that falls back to the tree walker if the
+ * symbol has been rebound, as do macros and anything else the compiler
+ * does not handle, so both evaluators accept the same programs */
+void vm_enable(bool enabled);
+bool vm_enabled(void);
+
+/* evaluates a top-level form with whichever evaluator is enabled */
+awlval* vm_eval_top(awlenv* e, awlval* v);
+
+awlval* vm_eval(awlenv* e, awlval* v);
+
+void teardown_vm(void);
+
+#endif
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include "ptest.h"
 
 #include "common.h"
@@ -29,6 +30,32 @@ void test_builtin_arithmetic(void) {
             TEST_IASSERT(v->type == AWLVAL_INT)
             TEST_IASSERT(v->lng == 2L));
 
+    // Results on either side of the preallocated small integer range
+    TEST_ASSERT_CHAINED(e, "(+ 1023 1)",
+            TEST_IASSERT(v->type == AWLVAL_INT)
+            TEST_IASSERT(v->lng == 1024L));
+
+    TEST_ASSERT_CHAINED(e, "(- -256 1 -1)",
+            TEST_IASSERT(v->type == AWLVAL_INT)
+            TEST_IASSERT(v->lng == -256L));
+
+    // Integer operations that overflow fail rather than wrap
+    TEST_ASSERT_EQ(e, "(+ 9223372036854775806 1)", "9223372036854775807");
+    TEST_ASSERT_TYPE(e, "(+ 9223372036854775807 1)", AWLVAL_ERR);
+    TEST_ASSERT_TYPE(e, "(- -9223372036854775807 2)", AWLVAL_ERR);
+    TEST_ASSERT_TYPE(e, "(* 4611686018427387904 2)", AWLVAL_ERR);
+    TEST_ASSERT_TYPE(e, "(- (- -9223372036854775807 1))", AWLVAL_ERR);
+    TEST_ASSERT_TYPE(e, "(// (- -9223372036854775807 1) -1)", AWLVAL_ERR);
+    TEST_ASSERT_EQ(e, "(^ 3 39)", "4052555153018976267");
+
+    // A power too large for an integer is a float, as it always was
+    TEST_ASSERT_EQ(e, "(^ 3 40)", "12157665459056928768.0");
+    TEST_ASSERT_EQ(e, "(^ -3 41)", "-36472996377170786304.0");
+
+    // Once a float is involved, the rest is folded as floats
+    TEST_ASSERT_EQ(e, "(+ 1 2 0.5 1)", "4.5");
+    TEST_ASSERT_EQ(e, "(* 2 (/ 1 2) 4)", "4.0");
+
     teardown_test(e);
 }
 
@@ -349,6 +376,21 @@ void test_builtin_append(void) {
             TEST_IASSERT(v->cell[1]->type == AWLVAL_INT)
             TEST_IASSERT(v->cell[1]->lng == 9L));
 
+    // Strings
+    TEST_ASSERT_TYPE(e, "(append 'foo' {1})", AWLVAL_ERR);
+    TEST_ASSERT_TYPE(e, "(append {1} 'foo')", AWLVAL_ERR);
+    TEST_ASSERT_EQ(e, "(append 'foo' 'bar')", "'foobar'");
+    TEST_ASSERT_EQ(e, "(append '' 'a' '' 'bc')", "'abc'");
+
+    // Appending must not show through other holders of the same characters
+    TEST_EVAL(e, "(global s 'ab')");
+    TEST_EVAL(e, "(global t (append s 'cd'))");
+    TEST_ASSERT_EQ(e, "(append s 'xy')", "'abxy'");
+    TEST_ASSERT_EQ(e, "(append t 'ef')", "'abcdef'");
+    TEST_ASSERT_EQ(e, "t", "'abcd'");
+    TEST_ASSERT_EQ(e, "s", "'ab'");
+    TEST_ASSERT_EQ(e, "(len (reduce-left (fn (acc i) (append acc 'xyz')) (range 0 500) ''))", "1500");
+
     teardown_test(e);
 }
 
@@ -465,6 +507,138 @@ void test_builtin_slice(void) {
 
     TEST_ASSERT_EQ(e, "(slice x 5 1 -2)", "{2 4}");
 
+    // Long substrings share the characters of their source
+    TEST_EVAL(e, "(global s 'the quick brown fox jumps over the lazy dog')");
+    TEST_ASSERT_EQ(e, "(slice s 4)", "'quick brown fox jumps over the lazy dog'");
+    TEST_ASSERT_EQ(e, "(slice s 4 9)", "'quick'");
+    TEST_ASSERT_EQ(e, "(slice s 0 9 2)", "'teqik'");
+    TEST_ASSERT_EQ(e, "(slice s 2 -4)", "'e quick brown fox jumps over the lazy'");
+    TEST_ASSERT_EQ(e, "(reverse (slice s 2 -4))", "'yzal eht revo spmuj xof nworb kciuq e'");
+    TEST_ASSERT_EQ(e, "(== (slice s 0 36) (slice 'the quick brown fox jumps over the lazy cat' 0 36))", "true");
+    TEST_ASSERT_EQ(e, "(append (slice s 0 35) 'frog')", "'the quick brown fox jumps over the frog'");
+    TEST_ASSERT_EQ(e, "(== (convert :qsym (slice s 0 34)) (convert :qsym 'the quick brown fox jumps over the'))", "true");
+    TEST_ASSERT_EQ(e, "(convert :int (slice '12345678901234567890123456789012345' 0 6))", "123456");
+    TEST_ASSERT_EQ(e, "s", "'the quick brown fox jumps over the lazy dog'");
+
+    teardown_test(e);
+}
+
+void test_builtin_higher_order(void) {
+    awlenv* e = setup_test();
+
+    TEST_ASSERT_TYPE(e, "(map 5 {1 2})", AWLVAL_ERR);
+    TEST_ASSERT_TYPE(e, "(map (fn (x) x) 5)", AWLVAL_ERR);
+    TEST_ASSERT_TYPE(e, "(map (fn (x) (/ x 0)) {1 2})", AWLVAL_ERR);
+    TEST_ASSERT_EQ(e, "(map (fn (x) (* x x)) {1 2 3})", "{1 4 9}");
+    TEST_ASSERT_EQ(e, "(map (fn (x) x) {})", "{}");
+    TEST_ASSERT_EQ(e, "(map len {{1} {1 2}})", "{1 2}");
+
+    // Elements are evaluated as 'head' evaluates them
+    TEST_ASSERT_EQ(e, "(map (fn (x) x) {(+ 1 2) 4})", "{3 4}");
+
+    // Folds from the right, so the last element is seen first
+    TEST_ASSERT_EQ(e, "(reduce (fn (acc x) (cons x acc)) {1 2 3} {})", "{1 2 3}");
+    TEST_ASSERT_EQ(e, "(reduce - {1 2 3} 10)", "4");
+    TEST_ASSERT_EQ(e, "(reduce + {} 7)", "7");
+    TEST_ASSERT_TYPE(e, "(reduce + {1 :a} 0)", AWLVAL_ERR);
+
+    TEST_ASSERT_EQ(e, "(filter (fn (x) (> x 1)) {1 2 3 0 5})", "{2 3 5}");
+    TEST_ASSERT_TYPE(e, "(filter (fn (x) x) {1})", AWLVAL_ERR);
+
+    TEST_ASSERT_EQ(e, "(any (fn (x) (> x 2)) {1 2 3})", "true");
+    TEST_ASSERT_EQ(e, "(any (fn (x) (> x 5)) {1 2 3})", "false");
+    TEST_ASSERT_EQ(e, "(any (fn (x) x) {})", "false");
+    TEST_ASSERT_EQ(e, "(all (fn (x) (> x 0)) {1 2 3})", "true");
+    TEST_ASSERT_EQ(e, "(all (fn (x) (> x 1)) {1 2 3})", "false");
+    TEST_ASSERT_EQ(e, "(all (fn (x) x) {})", "true");
+    TEST_ASSERT_TYPE(e, "(all (fn (x) x) {1})", AWLVAL_ERR);
+
+    TEST_ASSERT_EQ(e, "(sum {1 2 3})", "6");
+    TEST_ASSERT_EQ(e, "(sum {})", "0");
+    TEST_ASSERT_EQ(e, "(sum {1 2.5})", "3.5");
+    TEST_ASSERT_TYPE(e, "(sum {1 :a})", AWLVAL_ERR);
+    TEST_ASSERT_TYPE(e, "(sum {9223372036854775807 1})", AWLVAL_ERR);
+    TEST_ASSERT_EQ(e, "(product {2 3 4})", "24");
+    TEST_ASSERT_EQ(e, "(product {})", "1");
+
+    TEST_ASSERT_EQ(e, "(zip {1 2 3} {:a :b} {4 5 6})", "{{1 :a 4} {2 :b 5}}");
+    TEST_ASSERT_EQ(e, "(zip {1 2} {})", "{}");
+    TEST_ASSERT_EQ(e, "(zip)", "{}");
+    TEST_ASSERT_TYPE(e, "(zip {1} 2)", AWLVAL_ERR);
+
+    TEST_ASSERT_EQ(e, "(member? 3 {1 2 3})", "true");
+    TEST_ASSERT_EQ(e, "(member? 4 {1 2 3})", "false");
+    TEST_ASSERT_EQ(e, "(member? {1} {{1} 2})", "true");
+    TEST_ASSERT_TYPE(e, "(member? 1 2)", AWLVAL_ERR);
+
+    // Given too few arguments, they are partially applied as functions are
+    TEST_ASSERT_EQ(e, "((map (fn (x) (* 2 x))) {1 2 3})", "{2 4 6}");
+    TEST_EVAL(e, "(define square (map (fn (x) (* x x))))");
+    TEST_ASSERT_EQ(e, "(square {1 2 3 4})", "{1 4 9 16}");
+    TEST_ASSERT_EQ(e, "(((reduce -) {1 2 3}) 10)", "4");
+    TEST_ASSERT_EQ(e, "((filter (fn (x) (> x 1))) {1 2 3})", "{2 3}");
+    TEST_ASSERT_EQ(e, "((member? 3) {1 2 3})", "true");
+    TEST_ASSERT_EQ(e, "((sum) {1 2 3})", "6");
+    TEST_ASSERT_TYPE(e, "((map 5) {1 2})", AWLVAL_ERR);
+
+    // Long lists take neither deep recursion nor quadratic copying
+    TEST_ASSERT_EQ(e, "(sum (map (fn (x) (* 2 x)) (range 0 100000)))", "9999900000");
+    TEST_ASSERT_EQ(e, "(len (filter (fn (x) (== 0 (% x 3))) (range 0 100000)))", "33334");
+
+    teardown_test(e);
+}
+
+void test_builtin_range(void) {
+    awlenv* e = setup_test();
+
+    TEST_ASSERT_TYPE(e, "(range :a 5)", AWLVAL_ERR);
+    TEST_ASSERT_TYPE(e, "(range 0)", AWLVAL_FN);
+    TEST_ASSERT_EQ(e, "(range 0 5)", "{0 1 2 3 4}");
+    TEST_ASSERT_EQ(e, "(range -2 1)", "{-2 -1 0}");
+    TEST_ASSERT_EQ(e, "(range 5 0)", "{}");
+    TEST_ASSERT_EQ(e, "(range 3 3)", "{}");
+
+    // Counts in the type of the start
+    TEST_ASSERT_EQ(e, "(range 0 2.5)", "{0 1 2}");
+    TEST_ASSERT_EQ(e, "(range 1.5 4)", "{1.5 2.5 3.5}");
+    TEST_ASSERT_EQ(e, "(len (range 0 100000))", "100000");
+
+    teardown_test(e);
+}
+
+void test_builtin_dict(void) {
+    awlenv* e = setup_test();
+
+    TEST_EVAL(e, "(global d [:a 1 :b 2])");
+
+    TEST_ASSERT_EQ(e, "(dict-get d :a)", "1");
+    TEST_ASSERT_TYPE(e, "(dict-get d :z)", AWLVAL_ERR);
+    TEST_ASSERT_EQ(e, "(dict-haskey? d :b)", "true");
+    TEST_ASSERT_EQ(e, "(dict-haskey? d :z)", "false");
+
+    // Updates leave the original untouched
+    TEST_ASSERT_EQ(e, "(dict-get (dict-set d :a 5) :a)", "5");
+    TEST_ASSERT_EQ(e, "(len (dict-set d :c 3))", "3");
+    TEST_ASSERT_EQ(e, "(len (dict-del d :a))", "1");
+    TEST_ASSERT_EQ(e, "(len (dict-del d :z))", "2");
+    TEST_ASSERT_EQ(e, "(dict-get d :a)", "1");
+    TEST_ASSERT_EQ(e, "(len d)", "2");
+
+    // Equality compares entries, not insertion order
+    TEST_ASSERT_EQ(e, "(== d [:b 2 :a 1])", "true");
+    TEST_ASSERT_EQ(e, "(== d [:a 1 :b 3])", "false");
+    TEST_ASSERT_EQ(e, "(== d [:a 1 :c 2])", "false");
+    TEST_ASSERT_EQ(e, "(== (dict-del (dict-set d :c 3) :c) d)", "true");
+
+    // Enough keys to push the map below its root node
+    TEST_EVAL(e, "(global key (fn (i) (convert :qsym (convert :str i))))");
+    TEST_EVAL(e, "(global big (reduce-left (fn (acc i) (dict-set acc (key i) i)) (range 0 200) []))");
+    TEST_ASSERT_EQ(e, "(len big)", "200");
+    TEST_ASSERT_EQ(e, "(dict-get big :150)", "150");
+    TEST_ASSERT_EQ(e, "(len (dict-keys big))", "200");
+    TEST_ASSERT_EQ(e, "(len (reduce-left (fn (acc i) (dict-del acc (key i))) (range 0 150) big))", "50");
+    TEST_ASSERT_EQ(e, "(len big)", "200");
+
     teardown_test(e);
 }
 
@@ -578,6 +752,41 @@ void test_builtin_convert(void) {
     teardown_test(e);
 }
 
+static char printed[64];
+
+static void print_to_buffer(char* s) {
+    strncat(printed, s, sizeof(printed) - strlen(printed) - 1);
+}
+
+void test_builtin_print(void) {
+    awlenv* e = setup_test();
+    register_print_fn(print_to_buffer);
+
+    printed[0] = '\0';
+    TEST_ASSERT_EQ(e, "(println 'a' 1 {2})", "{}");
+    PT_ASSERT_STR_EQ(printed, "a 1 {2}\n");
+
+    // The line is ended even when an argument fails, by either evaluator
+    printed[0] = '\0';
+    TEST_ASSERT_TYPE(e, "(println (/ 1 0))", AWLVAL_ERR);
+    PT_ASSERT_STR_EQ(printed, "\n");
+
+    printed[0] = '\0';
+    TEST_ASSERT_TYPE(e, "(println 'a' (println (/ 1 0)))", AWLVAL_ERR);
+    PT_ASSERT_STR_EQ(printed, "\n\n");
+
+    printed[0] = '\0';
+    TEST_ASSERT_TYPE(e, "(println 'a' ((fn (x) (/ x 0)) 1))", AWLVAL_ERR);
+    PT_ASSERT_STR_EQ(printed, "\n");
+
+    printed[0] = '\0';
+    TEST_ASSERT_TYPE(e, "(print 'a' (/ 1 0))", AWLVAL_ERR);
+    PT_ASSERT_STR_EQ(printed, "");
+
+    register_default_print_fn();
+    teardown_test(e);
+}
+
 void suite_builtin(void) {
     pt_add_test(test_builtin_arithmetic, "Test Arithmetic", "Suite Builtin");
     pt_add_test(test_builtin_div, "Test Div", "Suite Builtin");
@@ -596,9 +805,13 @@ void suite_builtin(void) {
     pt_add_test(test_builtin_len, "Test Len", "Suite Builtin");
     pt_add_test(test_builtin_reverse, "Test Reverse", "Suite Builtin");
     pt_add_test(test_builtin_slice, "Test Slice", "Suite Builtin");
+    pt_add_test(test_builtin_higher_order, "Test Higher-Order Functions", "Suite Builtin");
+    pt_add_test(test_builtin_range, "Test Range", "Suite Builtin");
+    pt_add_test(test_builtin_dict, "Test Dict", "Suite Builtin");
     pt_add_test(test_builtin_if, "Test If", "Suite Builtin");
     pt_add_test(test_builtin_var, "Test Var", "Suite Builtin");
     pt_add_test(test_builtin_let, "Test Let", "Suite Builtin");
     pt_add_test(test_builtin_lambda, "Test Lambda", "Suite Builtin");
     pt_add_test(test_builtin_convert, "Test Convert", "Suite Builtin");
+    pt_add_test(test_builtin_print, "Test Print", "Suite Builtin");
 }
@@ -26,3 +26,10 @@ awlenv* setup_test(void) {
 void teardown_test(awlenv* e) {
     awlenv_del_top_level(e);
 }
+
+void teardown_tests(void) {
+    if (clean_env) {
+        awlenv_del_top_level(clean_env);
+        clean_env = NULL;
+    }
+}
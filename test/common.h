@@ -67,5 +67,7 @@
 awlval* eval_string(awlenv* e, char* input);
 awlenv* setup_test(void);
 void teardown_test(awlenv* e);
+/* frees the environment each test's is copied from */
+void teardown_tests(void);
 
 #endif
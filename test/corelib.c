@@ -7,7 +7,9 @@
 void test_corelib_do(void) {
     awlenv* e = setup_test();
 
+    TEST_ASSERT_EQ(e, "(do)", "{}");
     TEST_ASSERT_TYPE(e, "(do x)", AWLVAL_ERR);
+    TEST_ASSERT_TYPE(e, "(do (/ 1 0) 5)", AWLVAL_ERR);
     TEST_ASSERT_TYPE(e, "(do (/ 1 0))", AWLVAL_ERR);
 
     TEST_ASSERT_EQ(e, "(do (let ((x 5) (y 6)) (+ x y)))", "11");
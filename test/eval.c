@@ -1,8 +1,12 @@
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include "ptest.h"
 
 #include "common.h"
+#include "../src/eval.h"
+#include "../src/intern.h"
+#include "../src/vm.h"
 
 void test_eval_env(void) {
     awlenv* e = setup_test();
@@ -22,6 +26,19 @@ void test_eval_qsym(void) {
     TEST_ASSERT_TYPE(e, ":'test foo'", AWLVAL_QSYM);
     TEST_ASSERT_TYPE(e, ":\"test foo\"", AWLVAL_QSYM);
 
+    /* symbols are interned, so equal names share storage */
+    TEST_ASSERT_CHAINED(e, "{foo :foo :'foo' bar}",
+            TEST_IASSERT(v->cell[0]->sym == v->cell[1]->sym)
+            TEST_IASSERT(v->cell[1]->sym == v->cell[2]->sym)
+            TEST_IASSERT(v->cell[0]->sym != v->cell[3]->sym));
+    TEST_ASSERT_EQ(e, "(reverse :oof)", ":foo");
+    TEST_ASSERT_EQ(e, "(slice :xfoox 1 4)", ":foo");
+
+    /* and freed once nothing holds them */
+    int names = intern_count();
+    TEST_EVAL(e, "(len (map (fn (i) (convert :qsym (convert :str i))) (range 0 1000)))");
+    PT_ASSERT(intern_count() < names + 100);
+
     teardown_test(e);
 }
 
@@ -36,6 +53,8 @@ void test_eval_dict(void) {
     TEST_ASSERT_TYPE(e, "[]", AWLVAL_DICT);
     TEST_ASSERT_TYPE(e, "[:x 'y']", AWLVAL_DICT);
     TEST_ASSERT_TYPE(e, "[:x 'y' :z 'foo' :q 5]", AWLVAL_DICT);
+    TEST_ASSERT_EQ(e, "(len [:a 1 :b 2 :c 3 :d 4 :e 5 :f 6 :g 7 :h 8 :i 9 :j 10 :k 11 :l 12 :m 13])", "13");
+    TEST_ASSERT_EQ(e, "(dict-get [:a 1 :b 2 :c 3 :d 4 :e 5 :f 6 :g 7 :h 8 :i 9 :j 10 :k 11 :l 12 :m 13] :m)", "13");
 
     teardown_test(e);
 }
@@ -100,6 +119,346 @@ void test_eval_cexpr(void) {
     teardown_test(e);
 }
 
+void test_eval_shared_values(void) {
+    awlenv* e = setup_test();
+
+    // Bound values are shared by reference, and must never change in place
+    TEST_EVAL(e, "(define xs {1 2 3})");
+    TEST_ASSERT_EQ(e, "(cons 0 xs)", "{0 1 2 3}");
+    TEST_ASSERT_EQ(e, "(reverse xs)", "{3 2 1}");
+    TEST_ASSERT_EQ(e, "(tail xs)", "{2 3}");
+    TEST_ASSERT_EQ(e, "(append xs xs)", "{1 2 3 1 2 3}");
+    TEST_ASSERT_EQ(e, "xs", "{1 2 3}");
+
+    TEST_EVAL(e, "(define n 5)");
+    TEST_ASSERT_EQ(e, "(+ n 1.5)", "6.5");
+    TEST_ASSERT_EQ(e, "(== n 5.0)", "true");
+    TEST_ASSERT_CHAINED(e, "n",
+            TEST_IASSERT(v->type == AWLVAL_INT)
+            TEST_IASSERT(v->lng == 5L));
+
+    TEST_EVAL(e, "(define d [:a 1])");
+    TEST_ASSERT_EQ(e, "(len (dict-set d :b 2))", "2");
+    TEST_ASSERT_EQ(e, "(len d)", "1");
+
+    TEST_EVAL(e, "(define code {+ 1 2})");
+    TEST_ASSERT_EQ(e, "(eval code)", "3");
+    TEST_ASSERT_EQ(e, "code", "{+ 1 2}");
+
+    teardown_test(e);
+}
+
+void test_eval_cells(void) {
+    awlval* v = awlval_qexpr();
+    for (long i = 0; i < 100; i++) {
+        v = awlval_add(v, awlval_int(i));
+        v = awlval_add_front(v, awlval_int(-i - 1));
+    }
+    PT_ASSERT(v->count == 200);
+    PT_ASSERT(v->cell[0]->lng == -100L && v->cell[199]->lng == 99L);
+
+    /* popping from the front just advances the start */
+    awlval** cells = v->cell;
+    awlval_del(awlval_pop(v, 0));
+    PT_ASSERT(v->cell == cells + 1);
+    PT_ASSERT(v->cell[0]->lng == -99L);
+
+    awlval_del(awlval_pop(v, 150));
+    PT_ASSERT(v->cell[149]->lng == 50L && v->cell[150]->lng == 52L);
+
+    awlval* y = awlval_qexpr();
+    y = awlval_add(y, awlval_int(1000));
+    y = awlval_add(y, awlval_int(1001));
+    v = awlval_shift(v, y, 1);
+    PT_ASSERT(v->count == 200);
+    PT_ASSERT(v->cell[0]->lng == -99L && v->cell[1]->lng == 1000L && v->cell[3]->lng == -98L);
+
+    while (v->count > 1) {
+        awlval_del(awlval_pop(v, 0));
+    }
+    PT_ASSERT(v->cell[0]->lng == 99L);
+    awlval_del(v);
+}
+
+void test_eval_views(void) {
+    awlenv* e = setup_test();
+
+    TEST_EVAL(e, "(define xs (range 0 20))");
+    TEST_EVAL(e, "(define ys (tail (tail xs)))");
+
+    /* slices of a shared list borrow its cells */
+    TEST_ASSERT_CHAINED(e, "ys",
+            TEST_IASSERT(v->backing != NULL)
+            TEST_IASSERT(v->count == 18)
+            TEST_IASSERT(v->cell[0]->lng == 2L));
+    TEST_ASSERT_CHAINED(e, "(slice ys 1 15)",
+            TEST_IASSERT(v->backing != NULL)
+            TEST_IASSERT(v->cell[0]->lng == 3L));
+    TEST_ASSERT_CHAINED(e, "(slice ys 1 3)",
+            TEST_IASSERT(v->backing == NULL)
+            TEST_IASSERT(v->count == 2));
+
+    /* and copy them out before changing anything */
+    TEST_ASSERT_EQ(e, "(cons -1 ys)", "(cons -1 (slice xs 2))");
+    TEST_ASSERT_EQ(e, "(append ys {20})", "(append (slice xs 2) {20})");
+    TEST_ASSERT_EQ(e, "(reverse ys)", "(reverse (slice xs 2))");
+    TEST_ASSERT_EQ(e, "(eval (cons + (tail ys)))", "(sum (slice xs 3))");
+    TEST_ASSERT_EQ(e, "(len xs)", "20");
+    TEST_ASSERT_EQ(e, "(len ys)", "18");
+    TEST_ASSERT_EQ(e, "(head ys)", "2");
+
+    TEST_ASSERT_EQ(e, "(member? 19 xs)", "true");
+    TEST_ASSERT_EQ(e, "(nth 12 ys)", "14");
+
+    teardown_test(e);
+}
+
+void test_eval_frames(void) {
+    awlenv* e = setup_test();
+
+    /* calls share the frame of a partial application until they bind */
+    TEST_EVAL(e, "(define add (fn (a b) (+ a b)))");
+    TEST_EVAL(e, "(define inc (add 1))");
+    TEST_ASSERT_EQ(e, "(inc 2)", "3");
+    TEST_ASSERT_EQ(e, "(inc 5)", "6");
+
+    /* definitions inside a call stay in that call */
+    TEST_EVAL(e, "(define h (fn (x) (do (define y x) y)))");
+    TEST_ASSERT_EQ(e, "(h 1)", "1");
+    TEST_ASSERT_EQ(e, "(h 2)", "2");
+    TEST_ASSERT_TYPE(e, "y", AWLVAL_ERR);
+
+    /* closures keep the frame they were made in */
+    TEST_EVAL(e, "(func (mk n) (fn () n))");
+    TEST_EVAL(e, "(define c1 (mk 1))");
+    TEST_EVAL(e, "(define c2 (mk 2))");
+    TEST_ASSERT_EQ(e, "(c1)", "1");
+    TEST_ASSERT_EQ(e, "(c2)", "2");
+
+    TEST_EVAL(e, "(func (loop n acc) (if (== n 0) acc (loop (- n 1) (+ acc 2))))");
+    TEST_ASSERT_EQ(e, "(loop 20000 0)", "40000");
+
+    teardown_test(e);
+}
+
+void test_eval_special_forms(void) {
+    awlenv* e = setup_test();
+
+    /* 'make test' runs every suite with and without --vm; the VM compiles
+     * these forms inline, so they must behave exactly as the builtins do */
+    TEST_ASSERT_EQ(e, "(if (and true (or false true)) 1 2)", "1");
+    TEST_ASSERT_EQ(e, "(let ((a 1) (b (+ a 1))) (* a b))", "2");
+    TEST_ASSERT_EQ(e, "((fn (x y) (- x y)) 5 3)", "2");
+    TEST_ASSERT_TYPE(e, "(if 1 2 3)", AWLVAL_ERR);
+    TEST_ASSERT_TYPE(e, "(and true 1)", AWLVAL_ERR);
+    TEST_ASSERT_TYPE(e, "(or 1 true)", AWLVAL_ERR);
+    TEST_ASSERT_EQ(e, "(or true 1)", "true");
+    TEST_ASSERT_TYPE(e, "(let ((+ 1)) +)", AWLVAL_ERR);
+
+    TEST_EVAL(e, "(define z 1)");
+    TEST_ASSERT_TYPE(e, "(define z 2)", AWLVAL_ERR);
+    TEST_ASSERT_EQ(e, "z", "1");
+
+    /* a rebound name is an ordinary call */
+    TEST_EVAL(e, "(define k (fn (if) (if 1 2)))");
+    TEST_ASSERT_EQ(e, "(k +)", "3");
+
+    teardown_test(e);
+}
+
+void test_eval_slots(void) {
+    awlenv* e = setup_test();
+
+    /* formals are bound by position, including by partial application */
+    TEST_EVAL(e, "(define sub3 (fn (a b c) (- (- a b) c)))");
+    TEST_EVAL(e, "(define sub3-10 (sub3 10))");
+    TEST_ASSERT_EQ(e, "(sub3-10 2 3)", "5");
+    TEST_ASSERT_EQ(e, "((sub3-10 4) 1)", "5");
+    TEST_ASSERT_EQ(e, "((fn (x & xs) (cons x xs)) 1 2 3)", "{1 2 3}");
+    TEST_ASSERT_EQ(e, "((fn (& xs) xs))", "{}");
+    TEST_ASSERT_TYPE(e, "((fn (x) (define x 2)) 1)", AWLVAL_ERR);
+    TEST_ASSERT_TYPE(e, "((fn (x) x) 1 2)", AWLVAL_ERR);
+    TEST_ASSERT_TYPE(e, "((fn (x &) x) 1)", AWLVAL_ERR);
+    TEST_ASSERT_TYPE(e, "(sub3 10 2)", AWLVAL_FN);
+    TEST_ASSERT_EQ(e, "(sub3-10 2)", "(sub3 10 2)");
+    TEST_ASSERT_TYPE(e, "(sub3 10 2 3 4)", AWLVAL_ERR);
+
+    /* let bindings see earlier ones, and the enclosing ones until bound */
+    TEST_EVAL(e, "(define w 10)");
+    TEST_ASSERT_EQ(e, "((fn (x) (let ((y x) (z (+ y 1))) (list z y))) 1)", "{2 1}");
+    TEST_ASSERT_EQ(e, "((fn (x) (let ((v w) (w x)) (list v w))) 1)", "{10 1}");
+
+    /* a definition in an inner frame shadows a formal */
+    TEST_ASSERT_EQ(e, "((fn (x) (let ((y 1)) (do (define x 5) (+ x y)))) 1)", "6");
+    TEST_ASSERT_EQ(e, "((fn (x) (let ((y 1)) (do (define z 5) (+ x y)))) 1)", "2");
+
+    /* closures see the frames they were made in */
+    TEST_EVAL(e, "(define adder (fn (n) (let ((k 1)) (fn (x) (+ x n k)))))");
+    TEST_ASSERT_EQ(e, "((adder 2) 3)", "6");
+
+    teardown_test(e);
+}
+
+void test_eval_redefinition(void) {
+    awlenv* e = setup_test();
+
+    /* lookups cached by the VM must see later bindings */
+    TEST_EVAL(e, "(define g (fn () 1))");
+    TEST_EVAL(e, "(define f (fn () (g)))");
+    TEST_ASSERT_EQ(e, "(f)", "1");
+    TEST_EVAL(e, "((fn () (global g (fn () 2))))");
+    TEST_ASSERT_EQ(e, "(f)", "2");
+
+    TEST_EVAL(e, "(define h (fn (x) (do (define + -) (+ x 1))))");
+    TEST_ASSERT_EQ(e, "(h 1)", "0");
+    TEST_ASSERT_EQ(e, "(+ 1 1)", "2");
+    TEST_ASSERT_EQ(e, "(h 3)", "2");
+
+    /* and closures the bindings of the frames they were made in */
+    TEST_EVAL(e, "(define mk (fn (n) (do (define k n) (fn () k))))");
+    TEST_EVAL(e, "(define k1 (mk 1))");
+    TEST_EVAL(e, "(define k2 (mk 2))");
+    TEST_ASSERT_EQ(e, "(list (k1) (k2) (k1))", "{1 2 1}");
+
+    teardown_test(e);
+}
+
+void test_eval_expansions(void) {
+    awlenv* e = setup_test();
+
+    /* each call site expands a macro once */
+    TEST_EVAL(e, "(global expanded 0)");
+    TEST_EVAL(e, "(macro inc1 (x) (do (global expanded (+ expanded 1)) {+ @x 1}))");
+    TEST_EVAL(e, "(func (f y) (inc1 y))");
+    TEST_ASSERT_EQ(e, "(list (f 1) (f 2) (f 3))", "{2 3 4}");
+    TEST_ASSERT_EQ(e, "expanded", "1");
+
+    /* until the macro it names is rebound */
+    TEST_EVAL(e, "(macro dec1 (x) {- @x 1})");
+    TEST_EVAL(e, "(global m inc1)");
+    TEST_EVAL(e, "(func (g y) (m y))");
+    TEST_ASSERT_EQ(e, "(g 1)", "2");
+    TEST_EVAL(e, "((fn () (global m dec1)))");
+    TEST_ASSERT_EQ(e, "(g 1)", "0");
+
+    /* arguments evaluated at the call site make each expansion differ */
+    TEST_EVAL(e, "(define h (fn (y) (inc1 {\\y})))");
+    TEST_EVAL(e, "((fn () (global expanded 0)))");
+    TEST_ASSERT_EQ(e, "(list (h 1) (h 2))", "{2 3}");
+    TEST_ASSERT_EQ(e, "expanded", "2");
+
+    teardown_test(e);
+}
+
+void test_eval_folding(void) {
+    awlenv* e = setup_test();
+
+    TEST_ASSERT_EQ(e, "(* 60 60 24)", "86400");
+    TEST_ASSERT_EQ(e, "(len (tail {1 2 3}))", "2");
+    TEST_ASSERT_TYPE(e, "(/ 1 0)", AWLVAL_ERR);
+
+    /* folded calls are still evaluated once their builtins are rebound */
+    TEST_EVAL(e, "(define h (fn () (do (define + -) (+ 5 (* 2 1)))))");
+    TEST_ASSERT_EQ(e, "(h)", "3");
+    TEST_EVAL(e, "(define k (fn () (do (define * +) (+ 1 (* 2 3)))))");
+    TEST_ASSERT_EQ(e, "(k)", "6");
+    TEST_EVAL(e, "(define d (fn () (do (define / *) (/ 1 0))))");
+    TEST_ASSERT_EQ(e, "(d)", "0");
+    TEST_ASSERT_EQ(e, "(+ 5 (* 2 1))", "7");
+
+    /* and are unchanged as data */
+    TEST_ASSERT_EQ(e, "(qhead {(+ 1 2)})", "{+ 1 2}");
+    TEST_ASSERT_EQ(e, "(eval (append (qhead {(+ 1 2)}) {4}))", "7");
+
+    teardown_test(e);
+}
+
+static char printed[64];
+
+static void print_to_buffer(char* s) {
+    strncat(printed, s, sizeof(printed) - strlen(printed) - 1);
+}
+
+void test_eval_depth(void) {
+    awlenv* e = setup_test();
+
+    TEST_EVAL(e, "(define f (fn (n) (if (== n 0) 0 (+ 1 (f (- n 1))))))");
+    TEST_ASSERT_EQ(e, "(f 1000)", "1000");
+
+    /* going too deep is an error, and evaluation carries on after it */
+    awlval_eval_set_max_depth(500);
+    TEST_ASSERT_TYPE(e, "(f 1000)", AWLVAL_ERR);
+    TEST_ASSERT_TYPE(e, "(map f {10 1000})", AWLVAL_ERR);
+    TEST_ASSERT_EQ(e, "(f 100)", "100");
+    awlval_eval_set_max_depth(0);
+    PT_ASSERT(awlval_eval_max_depth() == AWL_MAX_DEPTH);
+    TEST_ASSERT_EQ(e, "(f 1000)", "1000");
+
+    /* running out of C stack only suggests the VM where it would help:
+     * recursion through map nests on the C stack either way */
+    TEST_EVAL(e, "(define g (fn (n) (if (== n 0) 0 (+ 1 (first (map g {(- n 1)}))))))");
+    eval_depth_t outer = awlval_eval_depth_swap(awlval_eval_depth_new(256 * 1024));
+    awlval_eval_set_max_depth(100000);
+    awlval* x = eval_string(e, "(f 1000000)");
+    PT_ASSERT(x->type == AWLVAL_ERR && (strstr(x->err, "--vm") != NULL) == !vm_enabled());
+    awlval_del(x);
+    x = eval_string(e, "(g 1000000)");
+    PT_ASSERT(x->type == AWLVAL_ERR && strstr(x->err, "out of C stack") && !strstr(x->err, "--vm"));
+    awlval_del(x);
+    awlval_eval_set_max_depth(0);
+
+    /* the VM's frames are on the heap, printing what they give included */
+    register_print_fn(print_to_buffer);
+    printed[0] = '\0';
+    x = eval_string(e, "(println (f 1000000))");
+    PT_ASSERT(x->type == (vm_enabled() ? AWLVAL_QEXPR : AWLVAL_ERR));
+    PT_ASSERT_STR_EQ(printed, vm_enabled() ? "1000000\n" : "\n");
+    awlval_del(x);
+    register_default_print_fn();
+    awlval_eval_depth_swap(outer);
+
+    /* nested data is scanned and let go of without recursing */
+    TEST_EVAL(e, "(define nest (fn (n) (if (== n 0) {} (list (nest (- n 1))))))");
+    TEST_ASSERT_EQ(e, "(len (nest 2000))", "1");
+    TEST_ASSERT_EQ(e, "(first (nest 2))", "{{{}}}");
+    TEST_ASSERT_EQ(e, "(let ((x 5)) {{{{\\x}}}})", "{{{{5}}}}");
+
+    teardown_test(e);
+}
+
+void test_eval_tail_calls(void) {
+    awlenv* e = setup_test();
+
+    /* calls in tail position run in constant space, however many let,
+     * do, if and macro forms they are nested in */
+    awlval_eval_set_max_depth(100);
+
+    TEST_EVAL(e, "(define count (fn (n) (if (== n 0) :done (let ((m (- n 1))) (count m)))))");
+    TEST_ASSERT_EQ(e, "(count 5000)", ":done");
+
+    TEST_EVAL(e, "(define step (fn (n) (do (define m (- n 1)) (if (== m 0) :done (step m)))))");
+    TEST_ASSERT_EQ(e, "(step 5000)", ":done");
+
+    TEST_EVAL(e, "(macro unless (c b) {if @c :done (let ((z 0)) @b)})");
+    TEST_EVAL(e, "(define ping (fn (n) (unless (== n 0) (do n (pong (- n 1))))))");
+    TEST_EVAL(e, "(define pong (fn (n) (let ((m n)) (if (== m 0) :done (ping (- m 1))))))");
+    TEST_ASSERT_EQ(e, "(ping 5000)", ":done");
+
+    /* a call whose result is still needed nests */
+    TEST_EVAL(e, "(define sum-to (fn (n) (if (== n 0) 0 (let ((m (- n 1))) (+ n (sum-to m))))))");
+    TEST_ASSERT_TYPE(e, "(sum-to 5000)", AWLVAL_ERR);
+    awlval_eval_set_max_depth(0);
+    TEST_ASSERT_EQ(e, "(sum-to 5000)", "12502500");
+
+    /* a let body runs in the let's own frame, which closures made in its
+     * bindings share, rather than in a copy of it */
+    TEST_EVAL(e, "(func (z x) (let ((g (fn () x))) (do (define x 99) (g))))");
+    TEST_ASSERT_EQ(e, "(z 1)", "99");
+    TEST_ASSERT_EQ(e, "(let ((g (fn () b))) (do (define b 2) (g)))", "2");
+
+    teardown_test(e);
+}
+
 void suite_eval(void) {
     pt_add_test(test_eval_env, "Test Env", "Suite Eval");
     pt_add_test(test_eval_qsym, "Test QSym", "Suite Eval");
@@ -107,4 +466,15 @@ void suite_eval(void) {
     pt_add_test(test_eval_qexpr, "Test QExpr", "Suite Eval");
     pt_add_test(test_eval_eexpr, "Test EExpr", "Suite Eval");
     pt_add_test(test_eval_cexpr, "Test CExpr", "Suite Eval");
+    pt_add_test(test_eval_shared_values, "Test Shared Values", "Suite Eval");
+    pt_add_test(test_eval_cells, "Test Cells", "Suite Eval");
+    pt_add_test(test_eval_views, "Test Views", "Suite Eval");
+    pt_add_test(test_eval_frames, "Test Frames", "Suite Eval");
+    pt_add_test(test_eval_special_forms, "Test Special Forms", "Suite Eval");
+    pt_add_test(test_eval_slots, "Test Slots", "Suite Eval");
+    pt_add_test(test_eval_redefinition, "Test Redefinition", "Suite Eval");
+    pt_add_test(test_eval_expansions, "Test Expansions", "Suite Eval");
+    pt_add_test(test_eval_folding, "Test Folding", "Suite Eval");
+    pt_add_test(test_eval_depth, "Test Depth", "Suite Eval");
+    pt_add_test(test_eval_tail_calls, "Test Tail Calls", "Suite Eval");
 }
@@ -0,0 +1,63 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include "ptest.h"
+
+#include "common.h"
+#include "../src/gc.h"
+
+void test_gc_cycles(void) {
+    awlenv* e = setup_test();
+
+    /* each call leaves its environment bound to a closure that refers
+     * back to it, which reference counting alone cannot free */
+    TEST_EVAL(e, "(func (counter n) (do (define get (fn () n)) get))");
+    gc_collect();
+    long before = gc_get_stats().live;
+
+    TEST_EVAL(e, "(map (fn (i) (counter i)) (range 0 50))");
+    PT_ASSERT(gc_get_stats().live > before);
+    PT_ASSERT(gc_collect() > 0);
+    PT_ASSERT(gc_get_stats().live == before);
+
+    teardown_test(e);
+}
+
+void test_gc_reachable(void) {
+    awlenv* e = setup_test();
+
+    TEST_EVAL(e, "(func (counter n) (do (define get (fn () n)) get))");
+    TEST_EVAL(e, "(define c (counter 7))");
+    TEST_EVAL(e, "(define cs (map counter {1 2 3}))");
+    gc_collect();
+    TEST_ASSERT_EQ(e, "(c)", "7");
+    TEST_ASSERT_EQ(e, "(map (fn (f) (f)) cs)", "{1 2 3}");
+
+    /* collections may run in the middle of an evaluation */
+    TEST_ASSERT_EQ(e, "(let ((x (counter 5))) (do (gc) (x)))", "5");
+
+    teardown_test(e);
+}
+
+void test_gc_stats(void) {
+    awlenv* e = setup_test();
+
+    gc_stats_t before = gc_get_stats();
+    TEST_ASSERT_TYPE(e, "(gc)", AWLVAL_INT);
+    gc_stats_t after = gc_get_stats();
+    PT_ASSERT(after.collections == before.collections + 1);
+    PT_ASSERT(after.total_pause >= before.total_pause);
+    PT_ASSERT(after.threshold >= GC_MIN_THRESHOLD);
+
+    TEST_ASSERT_TYPE(e, "(gc-stats)", AWLVAL_DICT);
+    TEST_ASSERT_TYPE(e, "(dict-get (gc-stats) :collections)", AWLVAL_INT);
+    TEST_ASSERT_TYPE(e, "(dict-get (gc-stats) :last-pause)", AWLVAL_FLOAT);
+    TEST_ASSERT_TYPE(e, "(gc 1)", AWLVAL_ERR);
+
+    teardown_test(e);
+}
+
+void suite_gc(void) {
+    pt_add_test(test_gc_cycles, "Test Cycles", "Suite GC");
+    pt_add_test(test_gc_reachable, "Test Reachable", "Suite GC");
+    pt_add_test(test_gc_stats, "Test Stats", "Suite GC");
+}
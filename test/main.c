@@ -1,24 +1,43 @@
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include "../src/awl.h"
+#include "../src/vm.h"
 #include "ptest.h"
+#include "common.h"
 
 void suite_parser(void);
 void suite_eval(void);
 void suite_builtin(void);
 void suite_corelib(void);
+void suite_pool(void);
+void suite_gc(void);
+void suite_sched(void);
+void suite_runtime(void);
+void suite_par(void);
 
 int main(int argc, char** argv) {
     /* Setup/teardown parser only once, since it isn't modified */
     setup_awl();
 
+    /* run the same tests against the bytecode VM */
+    if (argc > 1 && strcmp(argv[1], "--vm") == 0) {
+        vm_enable(true);
+    }
+
     pt_add_suite(suite_parser);
     pt_add_suite(suite_eval);
     pt_add_suite(suite_builtin);
     pt_add_suite(suite_corelib);
+    pt_add_suite(suite_pool);
+    pt_add_suite(suite_gc);
+    pt_add_suite(suite_sched);
+    pt_add_suite(suite_runtime);
+    pt_add_suite(suite_par);
 
     int retval = pt_run();
 
+    teardown_tests();
     teardown_awl();
     return retval;
 }
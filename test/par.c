@@ -0,0 +1,94 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include "ptest.h"
+
+#include "common.h"
+#include "../src/awl.h"
+#include "../src/par.h"
+
+void test_par_collections(void) {
+    awlenv* e = setup_test();
+
+    TEST_EVAL(e, "(func (sq x) (* x x))");
+    TEST_EVAL(e, "(define l (range 0 500))");
+    TEST_EVAL(e, "(define ls (map list l))");
+    TEST_EVAL(e, "(func (nat n) (do (yield n) (nat (+ n 1))))");
+    TEST_EVAL(e, "(define g (generator nat 0))");
+
+    /* the same results however many workers share the chunks */
+    static const int workers[] = { 1, 2, 4 };
+    for (int i = 0; i < 3; i++) {
+        par_set_workers(workers[i]);
+        TEST_ASSERT_EQ(e, "(== (pmap sq l) (map sq l))", "true");
+        TEST_ASSERT_EQ(e, "(== (pfilter (fn (x) (== 0 (% x 7))) l) (filter (fn (x) (== 0 (% x 7))) l))", "true");
+        TEST_ASSERT_EQ(e, "(preduce + l 0)", "124750");
+        TEST_ASSERT_EQ(e, "(== (preduce append ls {}) (reduce append ls {}))", "true");
+        TEST_ASSERT_EQ(e, "(pmap sq {1 2 3})", "{1 4 9}");
+        TEST_ASSERT_EQ(e, "(pmap sq {})", "{}");
+        TEST_ASSERT_EQ(e, "(preduce + {} 5)", "5");
+
+        /* as with map, which starts from the end, the last error is reported */
+        awlval* x = eval_string(e, "(pmap (fn (x) (if (< x 100) x (error (to-str x)))) l)");
+        PT_ASSERT(x->type == AWLVAL_ERR && streq(x->err, "499"));
+        awlval_del(x);
+        TEST_ASSERT_TYPE(e, "(pfilter sq l)", AWLVAL_ERR);
+
+        /* a generator or channel it could reach, and binding outside the
+         * function, fail the whole call on every path */
+        TEST_ASSERT_TYPE(e, "(pmap (fn (x) (next g)) l)", AWLVAL_ERR);
+        TEST_ASSERT_TYPE(e, "(pmap (fn (x) (generator nat x)) l)", AWLVAL_ERR);
+        TEST_ASSERT_TYPE(e, "(pmap (fn (x) (global zz x)) l)", AWLVAL_ERR);
+        TEST_ASSERT_TYPE(e, "zz", AWLVAL_ERR);
+        TEST_ASSERT_EQ(e, "(pmap (fn (x) (do (define y (sq x)) y)) {1 2 3})", "{1 4 9}");
+        TEST_ASSERT_EQ(e, "(let ((c (chan))) (len (pmap sq l)))", "500");
+    }
+
+    /* closures come back bound in the environments they were given */
+    par_set_workers(4);
+    TEST_EVAL(e, "(define adders (pmap (fn (x) (fn (y) (+ x y later))) l))");
+    TEST_EVAL(e, "(define later 10)");
+    TEST_ASSERT_EQ(e, "((nth 3 adders) 1)", "14");
+
+    /* nested calls run in the worker they are made from */
+    TEST_ASSERT_EQ(e, "(preduce + (pmap (fn (x) (preduce + (pmap sq (range 0 x)) 0)) (range 0 40)) 0)", "192660");
+
+    /* a channel belongs to this interpreter's tasks */
+    TEST_ASSERT_TYPE(e, "(let ((c (chan))) (pmap (fn (x) c) l))", AWLVAL_ERR);
+
+    TEST_ASSERT_TYPE(e, "(pmap 1 l)", AWLVAL_ERR);
+    TEST_ASSERT_TYPE(e, "(pfilter sq 1)", AWLVAL_ERR);
+    TEST_ASSERT_TYPE(e, "(preduce + l)", AWLVAL_FN);
+
+    par_set_workers(0);
+    teardown_test(e);
+}
+
+static void* par_aborter(void* arg) {
+    struct timespec wait = { 0, 50 * 1000000L };
+    nanosleep(&wait, NULL);
+    awl_runtime_abort(arg);
+    return NULL;
+}
+
+void test_par_abort(void) {
+    awlenv* e = setup_test();
+    par_set_workers(2);
+
+    /* an abort of the caller reaches the chunks running for it */
+    TEST_EVAL(e, "(func (spin n) (if (== n 0) 0 (spin (- n 1))))");
+    pthread_t aborter;
+    pthread_create(&aborter, NULL, par_aborter, awl_rt);
+    TEST_ASSERT_TYPE(e, "(pmap (fn (x) (spin 100000000)) (range 0 64))", AWLVAL_ERR);
+    pthread_join(aborter, NULL);
+    TEST_ASSERT_EQ(e, "(preduce + (range 0 64) 0)", "2016");
+
+    par_set_workers(0);
+    teardown_test(e);
+}
+
+void suite_par(void) {
+    pt_add_test(test_par_collections, "Test Collections", "Suite Par");
+    pt_add_test(test_par_abort, "Test Abort", "Suite Par");
+}
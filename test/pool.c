@@ -0,0 +1,63 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include "ptest.h"
+
+#include "common.h"
+#include "../src/pool.h"
+
+void test_pool_reuse(void) {
+    pool_stats_t before = pool_get_stats();
+
+    void* p = pool_alloc(sizeof(awlval));
+    pool_free(p, sizeof(awlval));
+    void* q = pool_alloc(sizeof(awlval));
+
+    pool_stats_t after = pool_get_stats();
+
+#ifndef AWL_NO_POOL
+    PT_ASSERT(p == q);
+    PT_ASSERT(after.hits > before.hits);
+#endif
+    PT_ASSERT(after.hits + after.misses + after.large > before.hits + before.misses + before.large);
+
+    pool_free(q, sizeof(awlval));
+}
+
+void test_pool_realloc(void) {
+    awlval** cells = pool_alloc(sizeof(awlval*) * 2);
+    cells[0] = awlval_int(1);
+    cells[1] = awlval_int(2);
+
+    cells = pool_realloc(cells, sizeof(awlval*) * 2, sizeof(awlval*) * 64);
+    PT_ASSERT(cells[0]->lng == 1L);
+    PT_ASSERT(cells[1]->lng == 2L);
+
+    cells = pool_realloc(cells, sizeof(awlval*) * 64, sizeof(awlval*) * 1);
+    PT_ASSERT(cells[0]->lng == 1L);
+
+    pool_free(cells, sizeof(awlval*) * 1);
+}
+
+void test_pool_eval(void) {
+    awlenv* e = setup_test();
+
+    TEST_EVAL(e, "(define xs (range 0 100))");
+#ifndef AWL_NO_POOL
+    pool_stats_t before = pool_get_stats();
+#endif
+    TEST_ASSERT_EQ(e, "(len (map (fn (x) (* x x)) xs))", "100");
+
+#ifndef AWL_NO_POOL
+    /* values freed while evaluating are recycled */
+    pool_stats_t after = pool_get_stats();
+    PT_ASSERT(after.hits - before.hits > after.misses - before.misses);
+#endif
+
+    teardown_test(e);
+}
+
+void suite_pool(void) {
+    pt_add_test(test_pool_reuse, "Test Reuse", "Suite Pool");
+    pt_add_test(test_pool_realloc, "Test Realloc", "Suite Pool");
+    pt_add_test(test_pool_eval, "Test Eval", "Suite Pool");
+}
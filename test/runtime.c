@@ -0,0 +1,93 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "ptest.h"
+
+#include "common.h"
+#include "../src/awl.h"
+#include "../src/vm.h"
+
+#define RUNTIME_THREADS 4
+
+typedef struct {
+    char input[160];
+    bool vm;
+    char* output;
+} runtime_job;
+
+static void* runtime_thread(void* arg) {
+    runtime_job* job = arg;
+    awl_runtime* rt = awl_runtime_new();
+    vm_enable(job->vm);
+
+    awlenv* e = awlenv_new_top_level();
+    awlval* x = eval_string(e, job->input);
+    job->output = awlval_to_str(x);
+    awlval_del(x);
+    awlenv_del_top_level(e);
+
+    awl_runtime_del(rt);
+    return NULL;
+}
+
+void test_runtime_threads(void) {
+    /* each interpreter binds the same names to values of its own */
+    static const char* expected[RUNTIME_THREADS] = { "610", "987", "1597", "2584" };
+    runtime_job jobs[RUNTIME_THREADS];
+    pthread_t threads[RUNTIME_THREADS];
+
+    for (int i = 0; i < RUNTIME_THREADS; i++) {
+        snprintf(jobs[i].input, sizeof(jobs[i].input),
+                "(do (global n %d) (func (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2))))) (fib n))",
+                15 + i);
+        jobs[i].vm = vm_enabled();
+        jobs[i].output = NULL;
+        pthread_create(&threads[i], NULL, runtime_thread, &jobs[i]);
+    }
+
+    for (int i = 0; i < RUNTIME_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        PT_ASSERT(jobs[i].output && streq(jobs[i].output, expected[i]));
+        free(jobs[i].output);
+    }
+
+    /* and this thread's is left as it was */
+    awlenv* e = setup_test();
+    TEST_ASSERT_EQ(e, "(+ 1 2)", "3");
+    teardown_test(e);
+}
+
+void test_runtime_abort(void) {
+    awlenv* e = setup_test();
+
+    /* acted on by the next call, and only that one */
+    awl_runtime_abort(awl_rt);
+    TEST_ASSERT_TYPE(e, "((fn (x) (+ x 2)) 1)", AWLVAL_ERR);
+    TEST_ASSERT_EQ(e, "((fn (x) (+ x 2)) 1)", "3");
+
+    teardown_test(e);
+}
+
+void test_runtime_random(void) {
+    awlenv* e = setup_test();
+
+    awl_runtime_seed(awl_rt, 42);
+    awlval* x = eval_string(e, "(list (random) (random))");
+    awl_runtime_seed(awl_rt, 42);
+    awlval* y = eval_string(e, "(list (random) (random))");
+    PT_ASSERT(awlval_eq(x, y));
+    PT_ASSERT(!awlval_eq(x->cell[0], x->cell[1]));
+    for (int i = 0; i < x->count; i++) {
+        PT_ASSERT(x->cell[i]->dbl >= 0.0 && x->cell[i]->dbl < 1.0);
+    }
+    awlval_del(x);
+    awlval_del(y);
+
+    teardown_test(e);
+}
+
+void suite_runtime(void) {
+    pt_add_test(test_runtime_threads, "Test Threads", "Suite Runtime");
+    pt_add_test(test_runtime_abort, "Test Abort", "Suite Runtime");
+    pt_add_test(test_runtime_random, "Test Random", "Suite Runtime");
+}
@@ -0,0 +1,131 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include "ptest.h"
+
+#include "common.h"
+#include "../src/sched.h"
+
+void test_sched_channels(void) {
+    awlenv* e = setup_test();
+
+    TEST_EVAL(e, "(define c (chan))");
+    TEST_ASSERT_EQ(e, "(typeof c)", ":chan");
+    TEST_ASSERT_EQ(e, "(chan? c)", "true");
+    TEST_ASSERT_EQ(e, "(== c c)", "true");
+    TEST_ASSERT_EQ(e, "(== c (chan))", "false");
+
+    /* values come out in the order they went in */
+    TEST_EVAL(e, "(send c 1)");
+    TEST_EVAL(e, "(send c {2 3})");
+    TEST_EVAL(e, "(send c 'four')");
+    TEST_ASSERT_EQ(e, "(list (recv c) (recv c) (recv c))", "{1 {2 3} 'four'}");
+
+    /* with nothing to send to it, waiting would never end */
+    TEST_ASSERT_TYPE(e, "(recv c)", AWLVAL_ERR);
+
+    TEST_ASSERT_TYPE(e, "(send 1 2)", AWLVAL_ERR);
+    TEST_ASSERT_TYPE(e, "(recv {})", AWLVAL_ERR);
+    TEST_ASSERT_TYPE(e, "(chan 1)", AWLVAL_ERR);
+
+    teardown_test(e);
+}
+
+void test_sched_spawn(void) {
+    awlenv* e = setup_test();
+
+    /* tasks only switch where these say, rather than when a slice is up */
+    sched_set_slice(60 * 1000000L);
+
+    /* a task's result, or its error, is sent to the channel spawn returns */
+    TEST_ASSERT_EQ(e, "(recv (spawn + 1 2))", "3");
+    TEST_ASSERT_EQ(e, "(recv (spawn (fn (x) (* x x)) 7))", "49");
+    TEST_ASSERT_TYPE(e, "(recv (spawn (fn () (/ 1 0))))", AWLVAL_ERR);
+    TEST_ASSERT_TYPE(e, "(spawn 1)", AWLVAL_ERR);
+    TEST_ASSERT_TYPE(e, "(spawn)", AWLVAL_ERR);
+
+    /* tasks take turns whenever one yields */
+    TEST_EVAL(e, "(define c (chan))");
+    TEST_EVAL(e, "(spawn (fn () (do (send c 1) (yield) (send c 3))))");
+    TEST_ASSERT_EQ(e, "(do (yield) (send c 2) (yield) (list (recv c) (recv c) (recv c)))", "{1 2 3}");
+    TEST_ASSERT_EQ(e, "(yield)", "{}");
+
+    /* tasks waiting on each other */
+    TEST_EVAL(e, "(define in (chan))");
+    TEST_EVAL(e, "(define out (chan))");
+    TEST_EVAL(e, "(func (echo n) (if (== n 0) :done (do (send out (+ (recv in) 1)) (echo (- n 1)))))");
+    TEST_EVAL(e, "(define echoed (spawn echo 100))");
+    TEST_EVAL(e, "(func (drive n acc) (if (== n 0) acc (do (send in n) (drive (- n 1) (+ acc (recv out))))))");
+    TEST_ASSERT_EQ(e, "(drive 100 0)", "5150");
+    TEST_ASSERT_EQ(e, "(recv echoed)", ":done");
+
+    /* the main evaluation is told when every task is waiting */
+    TEST_EVAL(e, "(define stuck (spawn (fn () (recv (chan)))))");
+    TEST_ASSERT_TYPE(e, "(recv stuck)", AWLVAL_ERR);
+
+    sched_set_slice(0);
+    PT_ASSERT(sched_slice() == SCHED_SLICE_USEC);
+
+    teardown_test(e);
+}
+
+void test_sched_preempt(void) {
+    awlenv* e = setup_test();
+
+    /* a task that never yields is still made to share its time */
+    TEST_EVAL(e, "(func (spin n) (if (== n 0) :spinner (spin (- n 1))))");
+    TEST_EVAL(e, "(define order (chan))");
+    TEST_EVAL(e, "(spawn (fn () (send order (spin 300000))))");
+    TEST_ASSERT_EQ(e, "(do (yield) (send order :main) (list (recv order) (recv order)))", "{:main :spinner}");
+
+    teardown_test(e);
+}
+
+void test_sched_generators(void) {
+    awlenv* e = setup_test();
+
+    TEST_EVAL(e, "(func (nat n) (do (yield n) (nat (+ n 1))))");
+    TEST_EVAL(e, "(define g (generator nat 0))");
+    TEST_ASSERT_EQ(e, "(typeof g)", ":gen");
+    TEST_ASSERT_EQ(e, "(gen? g)", "true");
+    TEST_ASSERT_EQ(e, "(list (next g) (next g) (next g))", "{0 1 2}");
+    TEST_ASSERT_EQ(e, "(gen-take 4 g)", "{3 4 5 6}");
+    TEST_ASSERT_EQ(e, "(done? g)", "false");
+
+    /* finishing gives nil from then on, and an error is passed on */
+    TEST_EVAL(e, "(define h (generator (fn (x) (do (yield x) :ignored)) 1))");
+    TEST_ASSERT_EQ(e, "(list (next h) (next h) (done? h) (next h))", "{1 {} true {}}");
+    TEST_ASSERT_EQ(e, "(gen-take 5 (generator (fn () (do (yield 1) (yield 2)))))", "{1 2}");
+    TEST_ASSERT_TYPE(e, "(gen-take 5 (generator (fn () (do (yield 1) (/ 1 0)))))", AWLVAL_ERR);
+
+    /* generators nest, each yielding to whoever resumed it */
+    TEST_EVAL(e, "(define outer (generator (fn () (let ((inner (generator nat 10))) "
+            "(do (yield (next inner)) (yield (* 2 (next inner))))))))");
+    TEST_ASSERT_EQ(e, "(gen-take 3 outer)", "{10 22}");
+
+    /* and run as part of the task that resumes them */
+    TEST_EVAL(e, "(define c (chan))");
+    TEST_EVAL(e, "(define relay (generator (fn () (do (yield (recv c)) (yield (recv c))))))");
+    TEST_EVAL(e, "(spawn (fn () (do (send c :a) (yield) (send c :b))))");
+    TEST_ASSERT_EQ(e, "(gen-take 2 relay)", "{:a :b}");
+    TEST_ASSERT_EQ(e, "(recv (spawn gen-take 3 (generator nat 7)))", "{7 8 9}");
+
+    TEST_EVAL(e, "(func (selfish) (next me))");
+    TEST_EVAL(e, "(global me (generator selfish))");
+    TEST_ASSERT_TYPE(e, "(next me)", AWLVAL_ERR);
+    TEST_ASSERT_TYPE(e, "(yield 1)", AWLVAL_ERR);
+    TEST_ASSERT_TYPE(e, "(generator 1)", AWLVAL_ERR);
+    TEST_ASSERT_TYPE(e, "(next 1)", AWLVAL_ERR);
+
+    /* one left suspended is closed when the interpreter is torn down */
+    TEST_EVAL(e, "(define left (generator nat 0))");
+    TEST_ASSERT_EQ(e, "(next left)", "0");
+
+    teardown_test(e);
+}
+
+void suite_sched(void) {
+    pt_add_test(test_sched_channels, "Test Channels", "Suite Sched");
+    pt_add_test(test_sched_spawn, "Test Spawn", "Suite Sched");
+    pt_add_test(test_sched_preempt, "Test Preempt", "Suite Sched");
+    pt_add_test(test_sched_generators, "Test Generators", "Suite Sched");
+}